@@ -0,0 +1,238 @@
+
+//=========================================================================//
+//
+//  ## R30X Fingerprint Sensor Library Example-03 ##
+//
+//  Filename : R30X-FPS-Backup.ino
+//  Description : Backs up the fingerprint library of a sensor to an SD card
+//                and restores it to another sensor. An interrupted backup
+//                or restore resumes where it stopped.
+//  Library version : 2.0.0
+//  Author : Vishnu M Aiea
+//  Src : https://github.com/vishnumaiea/R30X-Fingerprint-Sensor-Library
+//  Author's website : https://www.vishnumaiea.in
+//  License : MIT
+//
+//=========================================================================//
+//
+//  Some tips and info.
+//
+//  Use a board with a second hardware UART and an SD card slot, such as
+//  Arduino Due or ESP32.
+//  Send 'b' over the serial monitor to back up the library of the connected
+//  sensor, and 'r' to restore the backup to it. Send 'n' to forget the
+//  progress and start over.
+//  The progress is saved to a state file after every few templates. If the
+//  power goes off or the sensor is disconnected, send the same command again
+//  and it will continue from the last saved point.
+//  The sensor must use the same password and address as below.
+//
+//=========================================================================//
+
+#include "R30X_FPS.h"
+#include <SPI.h>
+#include <SD.h>
+
+//=========================================================================//
+//defines
+
+#define FPS_PASSWORD        0xFFFFFFFF  //default password and address is 0xFFFFFFFF
+#define FPS_ADDRESS         0xFFFFFFFF
+#define FPS_BAUDRATE        115200
+
+#define SD_CS_PIN           4 //chip select pin of the SD card
+#define BACKUP_FILE         "/LIBRARY.BAK"
+#define STATE_FILE          "/LIBRARY.STA"
+#define BATCH_SIZE          16  //the state is saved after this many templates
+
+//mode to open an existing file for reading and writing without truncating it
+#if defined(ESP32) || defined(ESP8266)
+  #define FILE_UPDATE "r+"
+#else
+  #define FILE_UPDATE (O_READ | O_WRITE)
+#endif
+
+//=========================================================================//
+
+R30X_FPS fps = R30X_FPS (&Serial1, FPS_PASSWORD, FPS_ADDRESS);
+
+FPS_BackupState backupState;
+char stateMode = 0; //'b' or 'r', the operation the state belongs to
+
+//=========================================================================//
+//load the saved progress, if any
+
+void loadState() {
+  File stateFile = SD.open(STATE_FILE);
+
+  if(stateFile && (stateFile.size() == (sizeof(backupState) + 1))) {
+    stateMode = stateFile.read();
+    stateFile.read((uint8_t*) &backupState, sizeof(backupState));
+  }
+  else {
+    stateMode = 0;
+    memset(&backupState, 0, sizeof(backupState));
+  }
+
+  if(stateFile) {
+    stateFile.close();
+  }
+}
+
+//=========================================================================//
+//save the progress so that it survives a reset
+
+void saveState() {
+  SD.remove(STATE_FILE);
+  File stateFile = SD.open(STATE_FILE, FILE_WRITE);
+
+  if(stateFile) {
+    stateFile.write(stateMode);
+    stateFile.write((uint8_t*) &backupState, sizeof(backupState));
+    stateFile.close();
+  }
+}
+
+//=========================================================================//
+//start a new backup or restore, or continue the last one
+
+void runTransfer (char mode) {
+  if(stateMode != mode) { //a different operation was in progress
+    stateMode = mode;
+    memset(&backupState, 0, sizeof(backupState));
+  }
+
+  if(backupState.finished) {
+    Serial.println(F("Already finished. Send 'n' to start over."));
+    return;
+  }
+
+  File backupFile;
+
+  if(mode == 'b') {
+    if(backupState.length == 0) {
+      SD.remove(BACKUP_FILE);
+      backupFile = SD.open(BACKUP_FILE, FILE_WRITE);
+    }
+    else {
+      backupFile = SD.open(BACKUP_FILE, FILE_UPDATE);
+    }
+  }
+  else {
+    backupFile = SD.open(BACKUP_FILE);
+  }
+
+  if(!backupFile) {
+    Serial.println(F("Opening the backup file failed."));
+    return;
+  }
+
+  backupFile.seek(backupState.length);  //resume from the last complete record
+
+  if(backupState.length > 0) {
+    Serial.print(F("Resuming from location #"));
+    Serial.println(backupState.location);
+  }
+
+  uint32_t startTime = millis();
+  uint16_t startCount = backupState.templateCount;
+  uint8_t response = FPS_RESP_OK;
+
+  while(!backupState.finished) {
+    if(mode == 'b') {
+      response = fps.backupLibrary(backupFile, &backupState, BATCH_SIZE);
+    }
+    else {
+      response = fps.restoreLibrary(backupFile, &backupState, BATCH_SIZE);
+    }
+
+    if(mode == 'b') {
+      backupFile.flush(); //make sure the records are on the card before the state says so
+    }
+    saveState();
+
+    Serial.print(F("Templates copied = "));
+    Serial.println(backupState.templateCount);
+
+    if(response != FPS_RESP_OK) {
+      break;
+    }
+  }
+
+  backupFile.close();
+
+  if(response != FPS_RESP_OK) {
+    Serial.print(F("Stopped at location #"));
+    Serial.print(backupState.location);
+    Serial.print(F(". response = 0x"));
+    Serial.println(response, HEX);
+    Serial.println(F("Check the sensor and send the same command again to resume."));
+    return;
+  }
+
+  uint32_t elapsedTime = millis() - startTime;
+
+  Serial.print(F("Finished in "));
+  Serial.print(elapsedTime / 1000);
+  Serial.println(F(" s"));
+
+  if(elapsedTime > 0) {
+    Serial.print(F("Templates per minute = "));
+    Serial.println((float(backupState.templateCount - startCount) * 60000.0) / elapsedTime);
+  }
+}
+
+//=========================================================================//
+//Arduino setup function
+
+void setup() {
+  Serial.begin(115200);
+  fps.begin(FPS_BAUDRATE);
+
+  Serial.println();
+  Serial.println(F("R30X Fingerprint Backup Sketch"));
+  Serial.println(F("=============================="));
+
+  if(!SD.begin(SD_CS_PIN)) {
+    Serial.println(F("SD card initialization failed."));
+    while(true);
+  }
+
+  if(fps.verifyPassword(FPS_PASSWORD) != FPS_RESP_OK) {
+    Serial.println(F("Verifying password failed."));
+    while(true);
+  }
+
+  loadState();
+
+  if((stateMode != 0) && !backupState.finished) {
+    Serial.print(F("An unfinished "));
+    Serial.print((stateMode == 'b') ? F("backup") : F("restore"));
+    Serial.println(F(" was found. Send the same command to resume it."));
+  }
+
+  Serial.println(F("b - back up the library"));
+  Serial.println(F("r - restore the library"));
+  Serial.println(F("n - forget the progress"));
+}
+
+//=========================================================================//
+//infinite loop
+
+void loop() {
+  if(Serial.available() > 0) {
+    char command = Serial.read();
+
+    if((command == 'b') || (command == 'r')) {
+      runTransfer(command);
+    }
+    else if(command == 'n') {
+      stateMode = 0;
+      memset(&backupState, 0, sizeof(backupState));
+      SD.remove(STATE_FILE);
+      Serial.println(F("Progress cleared."));
+    }
+  }
+}
+
+//=========================================================================//
@@ -0,0 +1,152 @@
+
+//=========================================================================//
+//
+//  ## R30X Fingerprint Sensor Library Example-04 ##
+//
+//  Filename : R30X-FPS-Clone.ino
+//  Description : Copies the fingerprint library of one sensor to several
+//                other sensors at the same time.
+//  Library version : 2.0.0
+//  Author : Vishnu M Aiea
+//  Src : https://github.com/vishnumaiea/R30X-Fingerprint-Sensor-Library
+//  Author's website : https://www.vishnumaiea.in
+//  License : MIT
+//
+//=========================================================================//
+//
+//  Some tips and info.
+//
+//  Use a board with four hardware UARTs and enough RAM for the template
+//  store, such as Arduino Due. The source sensor is on Serial1 and the
+//  target sensors are on Serial2 and Serial3. Add more targets to the list
+//  if your board has more ports.
+//  The library of the source sensor is read only once, to a template store
+//  in RAM. The templates are then sent to all the targets together, each
+//  target moving on to the next template as soon as it has saved one.
+//  Send 'c' over the serial monitor to start cloning. The templates already
+//  in the targets at the same locations will be replaced.
+//  All the sensors must use the same password and address as below.
+//
+//=========================================================================//
+
+#include "R30X_FPS.h"
+
+//=========================================================================//
+//defines
+
+#define FPS_PASSWORD        0xFFFFFFFF  //default password and address is 0xFFFFFFFF
+#define FPS_ADDRESS         0xFFFFFFFF
+#define FPS_BAUDRATE        57600
+
+#define TARGET_COUNT        2
+#define STORE_SIZE          32768 //templates are compressed, so this holds more than 64 of them
+
+//=========================================================================//
+
+R30X_FPS source = R30X_FPS (&Serial1, FPS_PASSWORD, FPS_ADDRESS);
+R30X_FPS target1 = R30X_FPS (&Serial2, FPS_PASSWORD, FPS_ADDRESS);
+R30X_FPS target2 = R30X_FPS (&Serial3, FPS_PASSWORD, FPS_ADDRESS);
+
+R30X_FPS* targets[TARGET_COUNT] = {&target1, &target2};
+R30X_FPS_Group targetGroup = R30X_FPS_Group (targets, TARGET_COUNT);
+
+uint8_t storeMemory[STORE_SIZE];
+FPS_TemplateStore store = FPS_TemplateStore (storeMemory, STORE_SIZE);
+
+uint8_t templateBuffers[TARGET_COUNT * FPS_CHARACTER_LENGTH];  //one template for each target
+
+//=========================================================================//
+//read the source library and send it to all the targets
+
+void runClone() {
+  store.format();
+
+  Serial.println(F("Reading the source library.."));
+  uint32_t startTime = millis();
+  uint8_t response = source.exportLibrary(&store);
+
+  if(response != FPS_RESP_OK) {
+    Serial.print(F("Reading the source failed. response = 0x"));
+    Serial.println(response, HEX);
+    return;
+  }
+
+  uint16_t templateCount = store.recordCount;
+
+  Serial.print(F("Templates read = "));
+  Serial.print(templateCount);
+  Serial.print(F(" in "));
+  Serial.print(millis() - startTime);
+  Serial.print(F(" ms, store length = "));
+  Serial.println(store.usedLength);
+
+  Serial.println(F("Cloning to the targets.."));
+  response = targetGroup.cloneLibrary(&store, templateBuffers);
+
+  for(uint8_t i=0; i < TARGET_COUNT; i++) {
+    Serial.print(F("Target "));
+    Serial.print(i + 1);
+    Serial.print(F(" : response = 0x"));
+    Serial.println(targetGroup.lastResponse[i], HEX);
+  }
+
+  Serial.print(F("Templates saved = "));
+  Serial.print(targetGroup.clonedCount);
+  Serial.print(F(" in "));
+  Serial.print(targetGroup.cloneTime);
+  Serial.println(F(" ms"));
+
+  if(targetGroup.cloneTime > 0) {
+    Serial.print(F("Templates per second = "));
+    Serial.println((float(targetGroup.clonedCount) * 1000.0) / targetGroup.cloneTime);
+  }
+
+  if(response != FPS_RESP_OK) {
+    Serial.println(F("Some targets failed. Check them and send 'c' again."));
+  }
+}
+
+//=========================================================================//
+//Arduino setup function
+
+void setup() {
+  Serial.begin(115200);
+  source.begin(FPS_BAUDRATE);
+  target1.begin(FPS_BAUDRATE);
+  target2.begin(FPS_BAUDRATE);
+
+  Serial.println();
+  Serial.println(F("R30X Fingerprint Clone Sketch"));
+  Serial.println(F("============================="));
+
+  if(source.verifyPassword(FPS_PASSWORD) != FPS_RESP_OK) {
+    Serial.println(F("Verifying the source password failed."));
+    while(true);
+  }
+
+  for(uint8_t i=0; i < TARGET_COUNT; i++) {
+    if(targets[i]->verifyPassword(FPS_PASSWORD) != FPS_RESP_OK) {
+      Serial.print(F("Verifying the password of target "));
+      Serial.print(i + 1);
+      Serial.println(F(" failed."));
+      while(true);
+    }
+  }
+
+  Serial.println(F("c - clone the library"));
+}
+
+//=========================================================================//
+//infinite loop
+
+void loop() {
+  if(Serial.available() > 0) {
+    char command = Serial.read();
+
+    if(command == 'c') {
+      runClone();
+    }
+  }
+}
+
+//=========================================================================//
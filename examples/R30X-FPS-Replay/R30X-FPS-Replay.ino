@@ -0,0 +1,252 @@
+
+//=========================================================================//
+//
+//  ## R30X Fingerprint Sensor Library Example-02 ##
+//
+//  Filename : R30X-FPS-Replay.ino
+//  Description : Replays recorded fingerprint images from an SD card
+//                through the enroll and identify paths of the sensor and
+//                reports the throughput and latency.
+//  Library version : 2.0.0
+//  Author : Vishnu M Aiea
+//  Src : https://github.com/vishnumaiea/R30X-Fingerprint-Sensor-Library
+//  Author's website : https://www.vishnumaiea.in
+//  License : MIT
+//
+//=========================================================================//
+//
+//  Some tips and info.
+//
+//  Use a board with a second hardware UART and an SD card slot, such as
+//  Arduino Due or ESP32.
+//  Images are the raw 36864 byte images produced by exportImage(). Save
+//  three captures of each finger to the replay directory, named with the
+//  user number and a letter, for example 001_A.RAW, 001_B.RAW and 001_C.RAW.
+//  A and B are used for enrolling and C is used for identifying.
+//  Users are enrolled to the library locations with the same number, so
+//  the library will be cleared before the test.
+//  Comment out FPS_DEBUG in the library header to get correct timings.
+//
+//=========================================================================//
+
+#include "R30X_FPS.h"
+#include <SPI.h>
+#include <SD.h>
+
+//=========================================================================//
+//defines
+
+#define FPS_PASSWORD        0xFFFFFFFF  //default password and address is 0xFFFFFFFF
+#define FPS_ADDRESS         0xFFFFFFFF
+#define FPS_BAUDRATE        57600 //change to compare baud rates
+#define FPS_DATA_LENGTH     128 //change to compare packet lengths (32, 64, 128 or 256)
+
+#define SD_CS_PIN           4 //chip select pin of the SD card
+#define REPLAY_DIRECTORY    "/REPLAY/"
+#define REPLAY_MAX_USERS    100 //no. of users to look for, from 001
+
+//=========================================================================//
+
+R30X_FPS fps = R30X_FPS (&Serial1, FPS_PASSWORD, FPS_ADDRESS);
+
+uint32_t identifyLatency[REPLAY_MAX_USERS]; //identify times in milliseconds
+uint16_t identifyCount = 0;
+
+//=========================================================================//
+//opens the image of a user from the replay directory
+//capture should be 'A', 'B' or 'C'
+
+File openImage (uint16_t user, char capture) {
+  char fileName[32];
+  sprintf(fileName, "%s%03u_%c.RAW", REPLAY_DIRECTORY, user, capture);
+  return SD.open(fileName);
+}
+
+//=========================================================================//
+//imports an image from the SD card and generates a character file from it
+
+uint8_t replayImage (uint16_t user, char capture, uint8_t bufferId) {
+  File imageFile = openImage(user, capture);
+
+  if(!imageFile) {
+    return FPS_BAD_VALUE;
+  }
+
+  uint8_t response = fps.importImage(&imageFile, FPS_IMAGE_LENGTH);
+  imageFile.close();
+
+  if(response != FPS_RESP_OK) {
+    return response;
+  }
+
+  return fps.generateCharacter(bufferId);
+}
+
+//=========================================================================//
+//sorts the latency values so that the percentiles can be read
+
+void sortLatency (uint32_t* values, uint16_t count) {
+  for(uint16_t i=1; i < count; i++) {  //insertion sort is good enough here
+    uint32_t value = values[i];
+    int16_t j = i - 1;
+
+    while((j >= 0) && (values[j] > value)) {
+      values[j + 1] = values[j];
+      j--;
+    }
+    values[j + 1] = value;
+  }
+}
+
+//=========================================================================//
+//Arduino setup function
+
+void setup() {
+  Serial.begin(115200);
+  fps.begin(FPS_BAUDRATE);
+
+  Serial.println();
+  Serial.println(F("R30X Fingerprint Replay Sketch"));
+  Serial.println(F("=============================="));
+
+  if(!SD.begin(SD_CS_PIN)) {
+    Serial.println(F("SD card initialization failed."));
+    while(true);
+  }
+
+  if(fps.verifyPassword(FPS_PASSWORD) != FPS_RESP_OK) {
+    Serial.println(F("Verifying password failed."));
+    while(true);
+  }
+
+  fps.setDataLength(FPS_DATA_LENGTH);
+  fps.readSysPara();  //print the configuration with the results
+  fps.clearLibrary();
+
+  //-------------------------------------------------------------------------//
+  //enroll path
+  //importImage -> generateCharacter x 2 -> generateTemplate -> saveTemplate
+
+  uint16_t enrollCount = 0;
+  uint16_t enrollFailCount = 0;
+  uint32_t enrollStartTime = millis();
+
+  for(uint16_t user=1; user <= REPLAY_MAX_USERS; user++) {
+    File imageFile = openImage(user, 'A');
+
+    if(!imageFile) { //no more users
+      break;
+    }
+    imageFile.close();
+
+    uint8_t response = replayImage(user, 'A', 1);
+
+    if(response == FPS_RESP_OK) {
+      response = replayImage(user, 'B', 2);
+    }
+    if(response == FPS_RESP_OK) {
+      response = fps.generateTemplate();
+    }
+    if(response == FPS_RESP_OK) {
+      response = fps.saveTemplate(1, user);
+    }
+
+    if(response == FPS_RESP_OK) {
+      enrollCount++;
+    }
+    else {
+      enrollFailCount++;
+      Serial.print(F("Enrolling failed for user "));
+      Serial.print(user);
+      Serial.print(F(". response = 0x"));
+      Serial.println(response, HEX);
+    }
+  }
+
+  uint32_t enrollTime = millis() - enrollStartTime;
+
+  //-------------------------------------------------------------------------//
+  //identify path
+  //importImage -> generateCharacter -> searchLibrary
+
+  uint16_t falseRejectCount = 0;
+  uint16_t misidentifyCount = 0;
+  uint16_t identifyErrorCount = 0;  //the image could not be imported or searched, not a reject
+
+  for(uint16_t user=1; user <= REPLAY_MAX_USERS; user++) {
+    File imageFile = openImage(user, 'C');
+
+    if(!imageFile) {
+      continue;
+    }
+    imageFile.close();
+
+    uint32_t startTime = millis();
+    uint8_t response = replayImage(user, 'C', 1);
+
+    if(response == FPS_RESP_OK) {
+      response = fps.searchLibrary(1, 1, REPLAY_MAX_USERS);
+    }
+
+    identifyLatency[identifyCount++] = millis() - startTime;
+
+    if(response == FPS_RESP_NOTFOUND) {
+      falseRejectCount++;
+    }
+    else if(response != FPS_RESP_OK) {
+      identifyErrorCount++;
+    }
+    else if(fps.fingerId != user) {
+      misidentifyCount++;
+    }
+  }
+
+  //-------------------------------------------------------------------------//
+  //report
+
+  Serial.println();
+  Serial.println(F("----- RESULTS -----"));
+  Serial.print(F("Baudrate = "));
+  Serial.println(FPS_BAUDRATE);
+  Serial.print(F("Data length = "));
+  Serial.println(fps.dataPacketLength);
+  Serial.print(F("System ID = 0x"));
+  Serial.println(fps.systemID, HEX);
+
+  Serial.print(F("Enrolled = "));
+  Serial.print(enrollCount);
+  Serial.print(F(", failed = "));
+  Serial.println(enrollFailCount);
+
+  if(enrollTime > 0) {
+    Serial.print(F("Enrolls per minute = "));
+    Serial.println((float(enrollCount) * 60000.0) / enrollTime);
+  }
+
+  if(identifyCount > 0) {
+    sortLatency(identifyLatency, identifyCount);
+    Serial.print(F("Identify p50 = "));
+    Serial.print(identifyLatency[(identifyCount - 1) / 2]);
+    Serial.println(F(" ms"));
+    Serial.print(F("Identify p99 = "));
+    Serial.print(identifyLatency[((identifyCount - 1) * 99) / 100]);
+    Serial.println(F(" ms"));
+  }
+
+  Serial.print(F("Identify attempts = "));
+  Serial.println(identifyCount);
+  Serial.print(F("False rejects = "));
+  Serial.println(falseRejectCount);
+  Serial.print(F("Misidentified = "));
+  Serial.println(misidentifyCount);
+  Serial.print(F("Identify errors = "));
+  Serial.println(identifyErrorCount);
+}
+
+//=========================================================================//
+//infinite loop
+
+void loop() {
+}
+
+//=========================================================================//
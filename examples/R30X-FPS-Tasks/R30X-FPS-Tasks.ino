@@ -0,0 +1,139 @@
+
+//=========================================================================//
+//
+//  ## R30X Fingerprint Sensor Library Example-05 ##
+//
+//  Filename : R30X-FPS-Tasks.ino
+//  Description : Runs the sensor from a FreeRTOS task of its own on ESP32.
+//                The other tasks send it requests through a queue.
+//  Library version : 2.0.0
+//  Author : Vishnu M Aiea
+//  Src : https://github.com/vishnumaiea/R30X-Fingerprint-Sensor-Library
+//  Author's website : https://www.vishnumaiea.in
+//  License : MIT
+//
+//=========================================================================//
+//
+//  Some tips and info.
+//
+//  This sketch is for ESP32 only. The sensor is on Serial2.
+//  Only the sensor task calls the functions of the sensor. The loop() task
+//  reads commands from the serial monitor and pushes them to the queue
+//  without waiting. The results are printed from the callback, which runs in
+//  the sensor task.
+//  Send 'i' to identify a finger, 'e' followed by a location to enroll a
+//  finger, and 'd' followed by a location to delete it. For example, "e 12".
+//  The sensor must use the same password and address as below.
+//
+//=========================================================================//
+
+#include "R30X_FPS.h"
+
+//=========================================================================//
+//defines
+
+#define FPS_PASSWORD        0xFFFFFFFF  //default password and address is 0xFFFFFFFF
+#define FPS_ADDRESS         0xFFFFFFFF
+#define FPS_BAUDRATE        57600
+
+#define FINGER_TIMEOUT      10000 //time to wait for a finger
+
+//=========================================================================//
+
+R30X_FPS fps = R30X_FPS (&Serial2, FPS_PASSWORD, FPS_ADDRESS);
+FPS_RequestQueue requestQueue;
+
+//=========================================================================//
+//called from the sensor task when a request is done
+
+void printResult (const FPS_Request* request, uint8_t response) {
+  if(response != FPS_RESP_OK) {
+    Serial.print(F("Request failed. response = 0x"));
+    Serial.println(response, HEX);
+    return;
+  }
+
+  if(request->type == FPS_REQUEST_IDENTIFY) {
+    Serial.print(F("Found at location #"));
+    Serial.print(request->fingerId);
+    Serial.print(F(", score = "));
+    Serial.println(request->matchScore);
+  }
+  else if(request->type == FPS_REQUEST_ENROLL) {
+    Serial.print(F("Enrolled at location #"));
+    Serial.println(request->location);
+  }
+  else {
+    Serial.print(F("Deleted location #"));
+    Serial.println(request->location);
+  }
+}
+
+//=========================================================================//
+//the only task that uses the sensor
+
+void sensorTask (void* parameter) {
+  fps.begin(FPS_BAUDRATE);
+
+  if(fps.verifySession() != FPS_RESP_OK) {
+    Serial.println(F("Verifying password failed."));
+  }
+
+  while(true) {
+    fps.processRequests(&requestQueue, 1000); //sleeps until a request comes
+  }
+}
+
+//=========================================================================//
+//Arduino setup function
+
+void setup() {
+  Serial.begin(115200);
+
+  Serial.println();
+  Serial.println(F("R30X Fingerprint Tasks Sketch"));
+  Serial.println(F("============================="));
+
+  xTaskCreate(sensorTask, "sensor", 8192, NULL, 2, NULL);
+
+  Serial.println(F("i - identify a finger"));
+  Serial.println(F("e <location> - enroll a finger"));
+  Serial.println(F("d <location> - delete a finger"));
+}
+
+//=========================================================================//
+//infinite loop
+
+void loop() {
+  if(Serial.available() > 0) {
+    char command = Serial.read();
+    FPS_Request request;
+
+    memset(&request, 0, sizeof(request));
+    request.priority = FPS_PRIORITY_FOREGROUND; //someone is waiting at the sensor
+    request.timeout = FINGER_TIMEOUT;
+    request.callback = printResult;
+
+    if(command == 'i') {
+      request.type = FPS_REQUEST_IDENTIFY;
+    }
+    else if(command == 'e') {
+      request.type = FPS_REQUEST_ENROLL;
+      request.location = Serial.parseInt();
+    }
+    else if(command == 'd') {
+      request.type = FPS_REQUEST_DELETE;
+      request.location = Serial.parseInt();
+      request.count = 1;
+    }
+    else {
+      return;
+    }
+
+    if(!requestQueue.push(&request)) {
+      Serial.println(F("The sensor is busy. Try again."));
+    }
+  }
+}
+
+//=========================================================================//
@@ -6,7 +6,7 @@
 //  Filename : R30X_FPS_Test.ino
 //  Description : Arduino compatible test program for Fingerprint_VMA
 //                library for R30X series fingerprint sensors.
-//  Library version : 1.3.1
+//  Library version : 2.0.0
 //  Author : Vishnu M Aiea
 //  Src : https://github.com/vishnumaiea/R30X-Fingerprint-Sensor-Library
 //  Author's website : https://www.vishnumaiea.in
@@ -190,6 +190,7 @@ void setup() {
   Serial.println(F("setdatlen <data length> - set data length"));
   Serial.println(F("capranser <timeout> <start location> <quantity> - capture and range search library for fingerprint"));
   Serial.println(F("capfulser - capture and full search the library for fingerprint"));
+  Serial.println(F("identify <timeout> - capture and identify fingerprint"));
   Serial.println(F("enroll <location> - enroll new fingerprint"));
   Serial.println(F("verpwd <password> - verify 4 byte device password"));
   Serial.println(F("setpwd <password> - set new 4 byte device password"));
@@ -198,13 +199,19 @@ void setup() {
   Serial.println(F("reinitprt <baudrate> - reinitialize the port without changing device configuration"));
   Serial.println(F("setseclvl <level> - set security level"));
   Serial.println(F("genimg - generate image"));
+  Serial.println(F("waitfin <timeout> - wait for a finger and generate image"));
+  Serial.println(F("expimg - export image and check its quality"));
   Serial.println(F("genchar <buffer id> - generate character file from image"));
+  Serial.println(F("expchr <buffer id> - export character file from buffer"));
   Serial.println(F("gentmp - generate template from character buffers"));
   Serial.println(F("savtmp <buffer id> <location> - save template to library from buffer"));
   Serial.println(F("lodtmp <buffer id> <location> - load template from library to buffer"));
   Serial.println(F("deltmp <start location> <quantity> - delete one or more templates from library"));
   Serial.println(F("mattmp - precisely match two templates available on buffers"));
   Serial.println(F("serlib <buffer id> <start location> <quantity> - search library for content on the buffer"));
+  #ifdef FPS_STATS
+    Serial.println(F("stats - print command statistics"));
+  #endif
   Serial.println(F(""));
   
   //this is optional
@@ -351,6 +358,17 @@ void loop() {
       response = fps.captureAndFullSearch();
     }
 
+    //-------------------------------------------------------------------------//
+    //capture a fingerprint and find it in the library
+    //timeout is in milliseconds
+    //eg. identify 10000
+
+    else if(commandString == "identify") {
+      uint32_t timeOut = firstParam.toInt();
+      Serial.println(F("Put your finger on the sensor.."));
+      response = fps.identify(timeOut);
+    }
+
     //-------------------------------------------------------------------------//
     //enroll a new fingerprint
     //you need to scan the finger twice
@@ -435,6 +453,38 @@ void loop() {
       response = fps.generateImage();
     }
 
+    //-------------------------------------------------------------------------//
+    //wait for a finger and save its image to the image buffer
+    //timeout is in milliseconds
+    //eg. waitfin 10000
+
+    else if(commandString == "waitfin") {
+      uint32_t timeOut = firstParam.toInt();
+      Serial.println(F("Put your finger on the sensor.."));
+      response = fps.waitForFinger(timeOut);
+    }
+
+    //-------------------------------------------------------------------------//
+    //export the image on the image buffer and check its quality
+    //the image is not saved here, only the quality metrics are calculated
+    //run genimg before this
+    //eg. expimg
+
+    else if(commandString == "expimg") {
+      response = fps.exportImage();
+
+      if(response == 0) {
+        response = fps.checkImageQuality();
+
+        if(response == 0) {
+          Serial.println(F("Image quality is good."));
+        }
+        else {
+          Serial.println(F("Image quality is poor. Press the finger harder and try again."));
+        }
+      }
+    }
+
     //-------------------------------------------------------------------------//
     //generate character file from image
     //buffer Id should be 1 or 2
@@ -445,6 +495,21 @@ void loop() {
       response = fps.generateCharacter(bufferId);
     }
 
+    //-------------------------------------------------------------------------//
+    //export the character file from one of the buffers
+    //buffer Id should be 1 or 2
+    //eg. expchr 1
+
+    else if(commandString == "expchr") {
+      uint8_t bufferId = firstParam.toInt();
+      response = fps.exportCharacter(bufferId);
+
+      if(response == 0) {
+        Serial.print(F("Character file length = "));
+        Serial.println(fps.characterLength);
+      }
+    }
+
     //-------------------------------------------------------------------------//
     //generate template from char buffers
     //template is the digital format of a fingerprint
@@ -512,6 +577,17 @@ void loop() {
       response = fps.searchLibrary(bufferId, startLocation, count);
     }
 
+    //-------------------------------------------------------------------------//
+    //print the latency and outcome statistics of the commands sent so far
+    //statistics are not available on AVR boards
+    //eg. stats
+
+    #ifdef FPS_STATS
+      else if(commandString == "stats") {
+        fps.printStats(Serial);
+      }
+    #endif
+
     //-------------------------------------------------------------------------//
     //unknown command
 
@@ -0,0 +1,133 @@
+//=========================================================================//
+//
+//  ## R30X Fingerprint Sensor Library - host build shim ##
+//
+//  Filename : Arduino.h
+//  Description : The parts of the Arduino API the library uses, implemented
+//                on a desktop OS so that the library can be built and run
+//                by group-bench.cpp. Nothing here is used on a board.
+//  Author : Vishnu M Aiea
+//  Src : https://github.com/vishnumaiea/R30X-Fingerprint-Sensor-Library
+//  License : MIT
+//
+//=========================================================================//
+
+#ifndef FPS_HOST_ARDUINO_H
+#define FPS_HOST_ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdlib.h>
+#include <chrono>
+#include <thread>
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define PROGMEM
+#define pgm_read_byte(p) (*(const uint8_t*)(p))
+#define pgm_read_word(p) (*(const uint16_t*)(p))
+#define memcpy_P memcpy
+
+class __FlashStringHelper;
+#define F(s) (reinterpret_cast<const __FlashStringHelper*>(s))
+
+#define HEX 16
+#define DEC 10
+#define LOW 0
+#define HIGH 1
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+#define CHANGE 1
+#define FALLING 2
+#define RISING 3
+#define NOT_AN_INTERRUPT -1
+
+//=========================================================================//
+//time, from the start of the program
+
+inline uint64_t hostMicros (void) {
+  static const std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+inline unsigned long millis (void) { return (unsigned long) (hostMicros() / 1000); }
+inline unsigned long micros (void) { return (unsigned long) hostMicros(); }
+inline void delay (unsigned long ms) { std::this_thread::sleep_for(std::chrono::milliseconds(ms)); }
+inline void delayMicroseconds (unsigned int us) { std::this_thread::sleep_for(std::chrono::microseconds(us)); }
+inline void yield (void) {}
+
+//=========================================================================//
+//there are no pins. a touch pin is never set by the benchmark
+
+inline void pinMode (uint8_t, uint8_t) {}
+inline int digitalRead (uint8_t) { return HIGH; }
+inline int digitalPinToInterrupt (uint8_t) { return NOT_AN_INTERRUPT; }
+inline void attachInterrupt (uint8_t, void (*)(void), int) {}
+inline void detachInterrupt (uint8_t) {}
+inline void noInterrupts (void) {}
+inline void interrupts (void) {}
+
+//=========================================================================//
+//text output is dropped. the benchmark prints its results with printf()
+
+class Print {
+  public:
+
+  virtual ~Print (void) {}
+  virtual size_t write (uint8_t value) = 0;
+  virtual size_t write (const uint8_t* buffer, size_t size) {
+    size_t i = 0;
+    for(; i < size; i++) {
+      write(buffer[i]);
+    }
+    return i;
+  }
+
+  template <class T> size_t print (T) { return 0; }
+  template <class T> size_t print (T, int) { return 0; }
+  template <class T> size_t println (T) { return 0; }
+  template <class T> size_t println (T, int) { return 0; }
+  size_t println (void) { return 0; }
+};
+
+class Stream : public Print {
+  public:
+
+  virtual int available (void) = 0;
+  virtual int read (void) = 0;
+  virtual int peek (void) = 0;
+  virtual void flush (void) {}
+
+  void setTimeout (unsigned long) {}
+
+  size_t readBytes (uint8_t* buffer, size_t length) {  //only what has already arrived
+    size_t count = 0;
+    while((count < length) && (available() > 0)) {
+      buffer[count++] = uint8_t(read());
+    }
+    return count;
+  }
+
+  size_t readBytes (char* buffer, size_t length) {
+    return readBytes((uint8_t*) buffer, length);
+  }
+};
+
+class HardwareSerial : public Stream {
+  public:
+
+  virtual void begin (unsigned long) {}
+  virtual void end (void) {}
+  int available (void) override { return 0; }
+  int read (void) override { return -1; }
+  int peek (void) override { return -1; }
+  size_t write (uint8_t) override { return 1; }
+  using Print::write;
+};
+
+extern HardwareSerial Serial; //the debug port, defined by the program
+
+#endif
@@ -0,0 +1,288 @@
+//=========================================================================//
+//
+//  ## R30X Fingerprint Sensor Library - sensor group benchmark ##
+//
+//  Filename : group-bench.cpp
+//  Description : Measures how the CPU time and the response latency of a
+//                R30X_FPS_Group scale from 1 to 64 sensors. The sensors are
+//                emulated, so this runs on a desktop without any hardware.
+//  Author : Vishnu M Aiea
+//  Src : https://github.com/vishnumaiea/R30X-Fingerprint-Sensor-Library
+//  License : MIT
+//
+//=========================================================================//
+//
+//  Build and run from the root of the library,
+//
+//    g++ -std=c++11 -O2 -Iextras/group-bench -Isrc extras/group-bench/group-bench.cpp src/R30X_FPS.cpp -o group-bench
+//    ./group-bench
+//
+//  The Arduino.h next to this file stands in for the Arduino core. Each
+//  emulated sensor answers a command after BENCH_PROCESSING_TIME, and sends
+//  the response one byte per byte time at BENCH_BAUDRATE, the way a real
+//  sensor does. Every sensor runs getTemplateCount() over and over through
+//  beginTemplateCount() and the completion callback of the group, so all of
+//  them are busy all the time. One loop polls the group, and sleeps for
+//  BENCH_POLL_GAP between the passes like a sketch would.
+//
+//  For each no. of sensors it prints the responses per second, the CPU time
+//  used by the loop (as a share of one core and per response), and the
+//  latency of the responses. The latency overhead is what the loop adds on
+//  top of the time the emulated sensor takes to answer.
+//
+//=========================================================================//
+
+#include "R30X_FPS.h"
+
+#include <stdio.h>
+#include <time.h>
+#include <vector>
+#include <algorithm>
+
+//=========================================================================//
+//defines
+
+#define BENCH_PROCESSING_TIME   20000   //time an emulated sensor takes to answer, in microseconds
+#define BENCH_BAUDRATE          57600   //speed the response bytes arrive at
+#define BENCH_POLL_GAP          200     //sleep between the passes of the poll loop, in microseconds
+#define BENCH_DURATION          3000000 //how long each no. of sensors is run, in microseconds
+#define BENCH_TEMPLATE_COUNT    42      //template count the emulated sensors report
+#define BENCH_MAX_FRAME         64      //longest command or response frame the emulator handles
+#define BENCH_RESPONSE_LENGTH   14      //frame length of the template count response
+
+HardwareSerial Serial;  //debug output, dropped
+
+//=========================================================================//
+//a sensor behind a serial port. it takes command frames as they are written
+//and makes the response bytes available as they would arrive
+
+class EmulatedSensor : public HardwareSerial {
+  public:
+
+  EmulatedSensor (void) : commandLength(0), responseLength(0), responseRead(0), responseStart(0) {
+    byteTime = 10000000UL / BENCH_BAUDRATE; //10 bits per byte
+  }
+
+  int available (void) override {
+    if(responseRead >= responseLength) {
+      return 0;
+    }
+
+    uint64_t now = hostMicros();
+
+    if(now < responseStart) {
+      return 0;
+    }
+
+    uint64_t arrived = ((now - responseStart) / byteTime) + 1;
+
+    if(arrived > responseLength) {
+      arrived = responseLength;
+    }
+
+    return int(arrived - responseRead);
+  }
+
+  int read (void) override {
+    if(available() <= 0) {
+      return -1;
+    }
+
+    return response[responseRead++];
+  }
+
+  int peek (void) override {
+    if(available() <= 0) {
+      return -1;
+    }
+
+    return response[responseRead];
+  }
+
+  size_t write (uint8_t value) override {
+    if(commandLength < BENCH_MAX_FRAME) {
+      command[commandLength++] = value;
+    }
+
+    if(commandLength >= FPS_FRAME_HEADER_LENGTH) {
+      uint16_t frameLength = FPS_FRAME_HEADER_LENGTH + ((uint16_t(command[7]) << 8) | command[8]);
+
+      if((commandLength >= frameLength) || (commandLength >= BENCH_MAX_FRAME)) {
+        respond();
+        commandLength = 0;
+      }
+    }
+
+    return 1;
+  }
+
+  size_t write (const uint8_t* buffer, size_t size) override {
+    for(size_t i=0; i < size; i++) {
+      write(buffer[i]);
+    }
+
+    return size;
+  }
+
+  uint64_t getResponseTime (void) { //time from the command to the last byte of the template count response
+    return BENCH_PROCESSING_TIME + (uint64_t(BENCH_RESPONSE_LENGTH) * byteTime);
+  }
+
+  private:
+
+  uint8_t command[BENCH_MAX_FRAME];
+  uint16_t commandLength;
+  uint8_t response[BENCH_MAX_FRAME];
+  uint16_t responseLength;
+  uint16_t responseRead;
+  uint64_t responseStart; //when the first byte of the response arrives
+  uint32_t byteTime;  //microseconds per byte
+
+  //build the acknowledgement for the command just received. the template
+  //count is answered, everything else is acknowledged with no data
+  void respond (void) {
+    uint8_t data[3] = {FPS_RESP_OK, 0, 0};
+    uint8_t dataLength = 1;
+
+    if(command[9] == FPS_CMD_TEMPLATECOUNT) {
+      data[1] = uint8_t(BENCH_TEMPLATE_COUNT >> 8);
+      data[2] = uint8_t(BENCH_TEMPLATE_COUNT & 0xFFU);
+      dataLength = 3;
+    }
+
+    uint16_t packetLength = dataLength + 2;
+    uint16_t checksum = FPS_ID_ACKPACKET + (packetLength >> 8) + (packetLength & 0xFFU);
+
+    responseLength = 0;
+    response[responseLength++] = uint8_t(FPS_ID_STARTCODE >> 8);
+    response[responseLength++] = uint8_t(FPS_ID_STARTCODE & 0xFFU);
+
+    for(uint8_t i=2; i < 6; i++) {  //the same address the command was sent to
+      response[responseLength++] = command[i];
+    }
+
+    response[responseLength++] = FPS_ID_ACKPACKET;
+    response[responseLength++] = uint8_t(packetLength >> 8);
+    response[responseLength++] = uint8_t(packetLength & 0xFFU);
+
+    for(uint8_t i=0; i < dataLength; i++) {
+      response[responseLength++] = data[i];
+      checksum += data[i];
+    }
+
+    response[responseLength++] = uint8_t(checksum >> 8);
+    response[responseLength++] = uint8_t(checksum & 0xFFU);
+
+    responseRead = 0;
+    responseStart = hostMicros() + BENCH_PROCESSING_TIME;
+  }
+};
+
+//=========================================================================//
+//what the completion callback needs to keep every sensor busy
+
+struct BenchContext {
+  uint64_t sendTime[FPS_GROUP_MAX_SENSORS]; //when the running command of each sensor was sent
+  std::vector<uint32_t> latencies;  //microseconds from sending to the result, of every response
+  uint32_t errorCount;
+  bool running; //start the next command when one completes
+};
+
+//=========================================================================//
+//called by the group when the response of a sensor is complete
+
+void onResponse (R30X_FPS* sensor, uint8_t index, uint8_t response, void* context) {
+  BenchContext* bench = (BenchContext*) context;
+  uint64_t now = hostMicros();
+
+  if((sensor->finishTemplateCount(response) == FPS_RESP_OK) && (sensor->templateCount == BENCH_TEMPLATE_COUNT)) {
+    bench->latencies.push_back(uint32_t(now - bench->sendTime[index]));
+  }
+  else {
+    bench->errorCount++;
+  }
+
+  if(bench->running) {
+    bench->sendTime[index] = hostMicros();
+
+    if(sensor->beginTemplateCount() != FPS_RX_OK) {
+      bench->errorCount++;
+    }
+  }
+}
+
+//=========================================================================//
+//run the given no. of sensors for BENCH_DURATION and print a line of results
+
+void runBench (uint8_t sensorCount) {
+  std::vector<EmulatedSensor> ports(sensorCount);
+  std::vector<R30X_FPS> sensors;
+  std::vector<R30X_FPS*> sensorList;
+
+  sensors.reserve(sensorCount); //the list points into it
+  for(uint8_t i=0; i < sensorCount; i++) {
+    sensors.push_back(R30X_FPS(&ports[i], FPS_DEFAULT_PASSWORD, FPS_DEFAULT_ADDRESS));
+    sensorList.push_back(&sensors[i]);
+  }
+
+  R30X_FPS_Group group(sensorList.data(), sensorCount);
+  BenchContext bench;
+  bench.errorCount = 0;
+  bench.running = true;
+  bench.latencies.reserve(size_t(sensorCount) * (BENCH_DURATION / BENCH_PROCESSING_TIME + 1));
+  group.onComplete(onResponse, &bench);
+
+  clock_t cpuStart = clock();
+  uint64_t wallStart = hostMicros();
+
+  for(uint8_t i=0; i < sensorCount; i++) {
+    bench.sendTime[i] = hostMicros();
+    sensors[i].beginTemplateCount();
+  }
+
+  while((hostMicros() - wallStart) < BENCH_DURATION) {
+    group.poll();
+    delayMicroseconds(BENCH_POLL_GAP);
+  }
+
+  bench.running = false;
+  group.waitAll();
+
+  double wallTime = double(hostMicros() - wallStart) / 1e6;
+  double cpuTime = double(clock() - cpuStart) / CLOCKS_PER_SEC;
+  std::vector<uint32_t>& latencies = bench.latencies;
+  std::sort(latencies.begin(), latencies.end());
+
+  if(latencies.empty()) {
+    printf("%8u  no responses, errors = %u\n", sensorCount, bench.errorCount);
+    return;
+  }
+
+  double idealTime = double(ports[0].getResponseTime()) / 1000.0;
+  double p50 = latencies[latencies.size() / 2] / 1000.0;
+  double p99 = latencies[(latencies.size() * 99) / 100] / 1000.0;
+
+  printf("%8u %10.0f %8.1f %10.1f %9.2f %9.2f %11.2f %7u\n", sensorCount,
+    latencies.size() / wallTime, (cpuTime * 100.0) / wallTime, (cpuTime * 1e6) / latencies.size(),
+    p50, p99, p99 - idealTime, bench.errorCount);
+}
+
+//=========================================================================//
+
+int main (void) {
+  printf("emulated response time = %.2f ms, poll gap = %u us\n\n",
+    double(EmulatedSensor().getResponseTime()) / 1000.0, BENCH_POLL_GAP);
+  printf("%8s %10s %8s %10s %9s %9s %11s %7s\n", "sensors", "resp/s", "cpu %", "cpu us/resp", "p50 ms", "p99 ms", "p99 over ms", "errors");
+
+  const uint8_t counts[] = {1, 2, 4, 8, 16, 32, 64};
+
+  for(uint8_t i=0; i < sizeof(counts); i++) {
+    if(counts[i] <= FPS_GROUP_MAX_SENSORS) {
+      runBench(counts[i]);
+    }
+  }
+
+  return 0;
+}
+
+//=========================================================================//
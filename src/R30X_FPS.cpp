@@ -6,7 +6,7 @@
 //  Filename : R30X_FPS.cpp                                                //
 //  Description : CPP file for R30X_FPS library for R30X series            //
 //                fingerprint sensors.                                     //
-//  Library version : 1.3.1                                                //
+//  Library version : 2.0.0                                                //
 //  Author : Vishnu M Aiea                                                 //
 //  Src : https://github.com/vishnumaiea/R30X-Fingerprint-Sensor-Library   //
 //  Author's website : https://www.vishnumaiea.in                          //
@@ -74,6 +74,15 @@ R30X_FPS::R30X_FPS (HardwareSerial *hs, uint32_t password, uint32_t address) {
   startCode[0] = FPS_ID_STARTCODE & 0xFFU; //packet start marker
   startCode[1] = (FPS_ID_STARTCODE >> 8) & 0xFFU;
 
+  #ifdef FPS_RX_EVENTS
+    rxEventSemaphore = NULL;  //created in begin()
+    rxFillLock = false;
+  #endif
+
+  #ifdef FPS_REQUEST_QUEUE
+    backgroundActive = false;
+  #endif
+
   resetParameters();  //initialize and reset and all parameters
 }
 
@@ -88,6 +97,10 @@ void R30X_FPS::begin (uint32_t baudrate) {
 
   if (hwSerial) hwSerial->begin(baudrate);
 
+  #ifdef FPS_RX_EVENTS
+    attachReceiveEvent();
+  #endif
+
   #if defined(__AVR__) || defined(ESP8266)
     if (swSerial) swSerial->begin(baudrate);
   #endif
@@ -103,6 +116,21 @@ void R30X_FPS::resetParameters (void) {
   dataPacketLength = FPS_DEFAULT_RX_DATA_LENGTH;
   librarySize = 1000;
   systemID = 0;
+  charBufferSlot[0] = 0;
+  charBufferSlot[1] = 0;
+  sessionVerified = false;
+  sysParaChanged = false;
+  sysParaCached = false;
+  streamGap = 0;
+
+  lastCommand = 0;
+  commandSendTime = 0;
+  awaitingAck = false;
+  ackTimedOut = false;
+
+  #ifdef FPS_ADAPTIVE_TIMEOUT
+    resetTimeouts();
+  #endif
 
   txPacketType = FPS_ID_COMMANDPACKET; //type of packet
   txInstructionCode = FPS_CMD_VERIFYPASSWORD; //
@@ -120,21 +148,59 @@ void R30X_FPS::resetParameters (void) {
   rxPacketLength[0] = 0;
   rxPacketLength[1] = 0;
   rxPacketLengthL = 0;
-  rxDataBuffer = NULL; //packet data buffer
+  rxDataBuffer = rxFrameBuffer + FPS_FRAME_HEADER_LENGTH + 1; //points into the received frame
   rxDataBufferLength = 0;
   rxPacketChecksum[0] = 0;
   rxPacketChecksum[1] = 0;
   rxPacketChecksumL = 0;
+  rxStartTime = 0;
+  rxTimeout = 0;
+  rxPending = false;
+  rxCancelled = false;
+  pendingBufferId = 1;
+  pendingLocation = 0;
+  resetFrame();
 
   fingerId = 0; //initialize them
   matchScore = 0;
   templateCount = 0;
+
+  imageLength = 0;
+  characterLength = 0;
+  dataStreamChecksum = 0;
+  resetImageQuality();
+
+  touchPin = FPS_NO_PIN;
+  touchActiveLevel = LOW;
+  touchEventFlag = false;
+  #if !defined(ESP32) && !defined(ESP8266)
+    touchSlot = -1;
+  #endif
+  lastFingerTime = 0;
+  presenceInterval = FPS_PRESENCE_SLOW_INTERVAL;
+
+  for(uint8_t i=0; i < FPS_IDENTIFY_HISTORY_LENGTH; i++) {
+    identifyHistory[i] = 0;
+  }
+  identifyHistoryIndex = 0;
+
+  #ifdef FPS_STATS
+    resetStats();
+  #endif
 }
 
 //=========================================================================//
 //send a data packet to the FPS (fingerprint scanner)
 
 uint8_t R30X_FPS::sendPacket (uint8_t type, uint8_t command, uint8_t* data, uint16_t dataLength) {
+  if(type == FPS_ID_COMMANDPACKET) {  //the response to a command must not mix with an older one
+    uint8_t response = finishCancelled();
+
+    if(response != FPS_RX_OK) {
+      return response;
+    }
+  }
+
   if(data != NULL) {  //sometimes there's no additional data except the command
     txDataBuffer = data;
     txDataBufferLength = dataLength;
@@ -144,6 +210,10 @@ uint8_t R30X_FPS::sendPacket (uint8_t type, uint8_t command, uint8_t* data, uint
     txDataBufferLength = 0;
   }
 
+  if(txDataBufferLength > FPS_MAX_DATA_LENGTH) { //won't fit in the frame buffer
+    return FPS_BAD_VALUE;
+  }
+
   txPacketType = type; //type of packet - 1 byte
   txInstructionCode = command; //instruction code - 1 byte
   txPacketLengthL = txDataBufferLength + 3; //1 byte for command, 2 bytes for checksum
@@ -152,30 +222,71 @@ uint8_t R30X_FPS::sendPacket (uint8_t type, uint8_t command, uint8_t* data, uint
 
   txPacketChecksumL = txPacketType + txPacketLength[0] + txPacketLength[1] + txInstructionCode; //sum of packet ID and packet length bytes
 
-  for(int i=0; i<txDataBufferLength; i++) {
-    txPacketChecksumL += txDataBuffer[i]; //add rest of the data bytes
-  }
+  //the data is copied into the frame while it is being added
+  txPacketChecksumL += copyWithChecksum(txFrameBuffer + FPS_FRAME_HEADER_LENGTH + 1, txDataBuffer, txDataBufferLength);
 
   txPacketChecksum[0] = txPacketChecksumL & 0xFFU; //get low byte
   txPacketChecksum[1] = (txPacketChecksumL >> 8) & 0xFFU; //get high byte
 
-  mySerial->write(startCode[1]); //high byte is sent first
-  mySerial->write(startCode[0]);
-  mySerial->write(deviceAddress[3]); //high byte is sent first
-  mySerial->write(deviceAddress[2]);
-  mySerial->write(deviceAddress[1]);
-  mySerial->write(deviceAddress[0]);
-  mySerial->write(txPacketType);
-  mySerial->write(txPacketLength[1]); //high byte is sent first
-  mySerial->write(txPacketLength[0]);
-  mySerial->write(txInstructionCode);
+  return writeCommandFrame();
+}
+
+//=========================================================================//
+//send a command that has no data. the checksum is worked out at compile time
+//by sendCommand<>(), so there's nothing left to calculate here
+
+uint8_t R30X_FPS::sendFixedPacket (uint8_t command, uint16_t checksum) {
+  txDataBuffer = NULL;
+  txDataBufferLength = 0;
+  txPacketType = FPS_ID_COMMANDPACKET;
+  txInstructionCode = command;
+  txPacketLengthL = 3;  //1 byte for command, 2 bytes for checksum
+  txPacketLength[0] = 3;
+  txPacketLength[1] = 0;
+  txPacketChecksumL = checksum;
+  txPacketChecksum[0] = checksum & 0xFFU;
+  txPacketChecksum[1] = (checksum >> 8) & 0xFFU;
+
+  return writeCommandFrame();
+}
+
+//=========================================================================//
+//assemble the command packet described by the tx parameters and send it
+
+uint8_t R30X_FPS::writeCommandFrame (void) {
+  //the whole frame is assembled first and sent with a single write so that
+  //the serial driver can send it as a block
+  uint16_t frameLength = buildFrameHeader(txPacketType, txPacketLengthL);
+  txFrameBuffer[frameLength++] = txInstructionCode;
+  frameLength += txDataBufferLength;  //the data was copied in by sendPacket()
+
+  txFrameBuffer[frameLength++] = txPacketChecksum[1];
+  txFrameBuffer[frameLength++] = txPacketChecksum[0];
+
+  if(ackTimedOut) { //don't take a late response as the response to this command
+    flushInput();
+    ackTimedOut = false;
+  }
+
+  mySerial->write(txFrameBuffer, frameLength);
 
-  for(int i=(txDataBufferLength-1); i>=0; i--) {
-    mySerial->write(txDataBuffer[i]); //send high byte first
+  if(txPacketType == FPS_ID_COMMANDPACKET) {
+    trackCharBuffers();
   }
 
-  mySerial->write(txPacketChecksum[1]);
-  mySerial->write(txPacketChecksum[0]);
+  lastCommand = txInstructionCode; //the response will be accounted to this command
+  commandSendTime = millis();
+  awaitingAck = true;
+
+  #ifdef FPS_STATS
+    statsFirstByteTime = 0;
+
+    FPS_CommandStats* stats = getCommandStats(lastCommand);
+    if(stats != NULL) {
+      stats->count++;
+      stats->bytesSent += frameLength;
+    }
+  #endif
 
   #ifdef FPS_DEBUG
     debugPort.print(F("Sent packet = "));
@@ -200,8 +311,8 @@ uint8_t R30X_FPS::sendPacket (uint8_t type, uint8_t command, uint8_t* data, uint
     debugPort.print(txInstructionCode, HEX);
     debugPort.print(F("-"));
 
-    for(int i=(txDataBufferLength-1); i>=0; i--) {
-      debugPort.print(txDataBuffer[i], HEX); //send high byte first
+    for(int i=0; i < txDataBufferLength; i++) {
+      debugPort.print(txDataBuffer[i], HEX);
       debugPort.print(F("-"));
     }
 
@@ -224,44 +335,260 @@ uint8_t R30X_FPS::sendPacket (uint8_t type, uint8_t command, uint8_t* data, uint
   return FPS_RX_OK;
 }
 
+//=========================================================================//
+//keep charBufferSlot up to date with the command just sent. a buffer is
+//forgotten as soon as a command that can change it is sent, since it's not
+//known what is in it if the command fails. this is done here and not in the
+//command functions so that the commands sent with beginCommand() are seen too
+
+void R30X_FPS::trackCharBuffers (void) {
+  uint8_t* commandData = txFrameBuffer + FPS_FRAME_HEADER_LENGTH + 1;
+  uint8_t bufferId = (txDataBufferLength > 0) ? commandData[0] : 0;
+
+  switch(txInstructionCode) {
+    case FPS_CMD_IMAGETOCHARACTER:
+    case FPS_CMD_IMPORTTEMPLATE:
+    case FPS_CMD_LOADTEMPLATE:  //loadTemplate() sets it again if it works
+      if((bufferId > 0) && (bufferId < 3)) {
+        charBufferSlot[bufferId - 1] = 0;
+      }
+      break;
+
+    case FPS_CMD_STORETEMPLATE:  //a buffer holding the old template at the location is out of date
+    case FPS_CMD_DELETETEMPLATE: {
+      uint16_t startLocation;
+      uint16_t count = 1;
+
+      if(txInstructionCode == FPS_CMD_STORETEMPLATE) {
+        startLocation = ((uint16_t(commandData[1]) << 8) | commandData[2]) + 1;
+      }
+      else {
+        startLocation = ((uint16_t(commandData[0]) << 8) | commandData[1]) + 1;
+        count = (uint16_t(commandData[2]) << 8) | commandData[3];
+      }
+
+      for(uint8_t i=0; i < 2; i++) {
+        if((charBufferSlot[i] >= startLocation) && (charBufferSlot[i] < (startLocation + count))) {
+          charBufferSlot[i] = 0;
+        }
+      }
+      break;
+    }
+
+    case FPS_CMD_GENERATETEMPLATE:  //the combined template replaces both
+    case FPS_CMD_CLEARLIBRARY:
+    case FPS_CMD_SCANANDRANGESEARCH:
+    case FPS_CMD_SCANANDFULLSEARCH:
+      charBufferSlot[0] = 0;
+      charBufferSlot[1] = 0;
+      break;
+  }
+}
+
 //=========================================================================//
 //receive a data packet from the FPS and extract values
 
 uint8_t R30X_FPS::receivePacket (uint32_t timeout) {
-  uint8_t* dataBuffer;
-  if(dataPacketLength < 64) { //data buffer length should be at least 64 bytes
-    dataBuffer = new uint8_t[64](); //this contains only the data
-  }
-  else {
-    dataBuffer = new uint8_t[FPS_DEFAULT_RX_DATA_LENGTH]();
+  uint8_t response = waitPacket(timeout);
+
+  //a module that was reset asks for the password again. verify it and send the
+  //command once more, so that the password has to be verified only once
+  if((response == FPS_RX_OK) && (rxPacketType == FPS_ID_ACKPACKET) && (txPacketType == FPS_ID_COMMANDPACKET) &&
+    (txInstructionCode != FPS_CMD_VERIFYPASSWORD) &&
+    ((rxConfirmationCode == FPS_RESP_WRONGPASSOWRD) || (rxConfirmationCode == FPS_RESP_COMPORTERR))) {
+    uint8_t command = txInstructionCode;  //verifyPassword() will overwrite these
+    uint8_t* data = txDataBuffer;
+    uint16_t dataLength = txDataBufferLength;
+    uint8_t confirmationCode = rxConfirmationCode;
+
+    endSession();
+
+    #ifdef FPS_DEBUG
+      debugPort.println(F("The module asked for the password. Verifying again.."));
+    #endif
+
+    if(verifyPassword(devicePasswordL) != FPS_RESP_OK) {
+      rxConfirmationCode = confirmationCode;  //report the error of the command
+      return FPS_RX_OK;
+    }
+
+    #ifdef FPS_STATS
+      FPS_CommandStats* stats = getCommandStats(command);
+      if(stats != NULL) {
+        stats->retries++;
+      }
+    #endif
+
+    response = sendPacket(FPS_ID_COMMANDPACKET, command, data, dataLength);
+
+    if(response == FPS_RX_OK) {
+      response = waitPacket(timeout);
+    }
   }
 
-  rxDataBuffer = dataBuffer;
-  uint8_t serialBuffer[FPS_DEFAULT_SERIAL_BUFFER_LENGTH] = {0}; //serialBuffer will store high byte at the start of the array
-  uint16_t serialBufferLength = 0;
-  uint8_t byteBuffer = 0;
+  return response;
+}
+
+//=========================================================================//
+//wait for a packet until it's complete or the timeout is reached
 
+uint8_t R30X_FPS::waitPacket (uint32_t timeout) {
   #ifdef FPS_DEBUG
     debugPort.println();
     debugPort.println(F("Reading response."));
   #endif
 
   //wait for message for a specific period
-  while (timeout > 0) {
-    if(mySerial->available()) {
-      byteBuffer = mySerial->read();
-      #ifdef FPS_DEBUG
-        // debugPort.print(F("Response byte found = "));
-        // debugPort.println(byteBuffer, HEX);
-      #endif
-      serialBuffer[serialBufferLength] = byteBuffer;
-      serialBufferLength++;
-    }
+  //the frame is assembled from the bytes as they arrive and we return as soon
+  //as it is complete. the bytes of the next packet (in a multi-packet data
+  //stream) are left in the serial buffer
+  beginReceive(timeout);
+  uint8_t response;
+
+  while((response = pollPacket()) == FPS_RX_PENDING) {
+    #ifdef FPS_RX_EVENTS
+      uint32_t elapsedTime = millis() - rxStartTime;
+
+      if((rxEventSemaphore != NULL) && (elapsedTime < rxTimeout)) {  //sleep until the UART reports new data
+        xSemaphoreTake(rxEventSemaphore, pdMS_TO_TICKS(rxTimeout - elapsedTime));
+      }
+      else {
+        delay(1);
+      }
+    #else
+      delay(1);
+    #endif
+  }
+
+  return response;
+}
+
+//=========================================================================//
+//start waiting for a packet without blocking. call pollPacket() until it stops
+//returning FPS_RX_PENDING. this lets a single loop drive many sensors, or do
+//other work while a command is running
+
+void R30X_FPS::beginReceive (uint32_t timeout) {
+  if(timeout == FPS_AUTO_TIMEOUT) {
+    #ifdef FPS_ADAPTIVE_TIMEOUT
+      timeout = awaitingAck ? getTimeout(lastCommand) : FPS_DEFAULT_TIMEOUT;  //data packets are not timed
+    #else
+      timeout = FPS_DEFAULT_TIMEOUT;
+    #endif
+  }
+
+  resetFrame();
+  rxStartTime = millis();
+  rxTimeout = timeout;
+  rxPending = true;
+  rxCancelled = false;
+}
+
+//=========================================================================//
+//read what has arrived for the packet started with beginReceive(). returns
+//FPS_RX_PENDING until the packet is complete or the timeout is reached, and
+//then the same codes as receivePacket()
+
+uint8_t R30X_FPS::pollPacket (void) {
+  if(!rxPending) {  //beginReceive() was not called
+    return FPS_RX_TIMEOUT;
+  }
+
+  if(!readFrame() && ((millis() - rxStartTime) < rxTimeout)) {
+    return FPS_RX_PENDING;
+  }
+
+  rxPending = false;
+  uint8_t response = checkFrame();
+
+  if(awaitingAck && (rxFrameLength < rxFrameExpectedLength)) { //the rest may still come
+    ackTimedOut = true;
+  }
+
+  #ifdef FPS_ADAPTIVE_TIMEOUT
+    updateTimeout(response);
+  #endif
+
+  #ifdef FPS_STATS
+    updateStats(response);
+  #endif
+
+  awaitingAck = false;  //the next packets are data packets, if any
+
+  if(rxCancelled) { //nobody is waiting for this one
+    rxCancelled = false;
+    return FPS_RX_CANCELLED;
+  }
+
+  return response;
+}
+
+//=========================================================================//
+//returns true if a packet is being waited for
+
+bool R30X_FPS::isReceiving (void) {
+  return rxPending;
+}
+
+//=========================================================================//
+//say the packet being received is not wanted anymore, eg. a search that was
+//overtaken by another sensor. the packet is still read to the end, so that
+//its bytes are not taken for the next one. pollPacket() returns
+//FPS_RX_CANCELLED for it
+
+void R30X_FPS::cancelReceive (void) {
+  if(rxPending) {
+    rxCancelled = true;
+  }
+}
+
+//=========================================================================//
+//a new command can't be sent while a packet is being received. if the packet
+//was cancelled, wait for it to complete and drop it. returns FPS_RX_PENDING
+//if the packet is still wanted, so the caller has to poll it first
+
+uint8_t R30X_FPS::finishCancelled (void) {
+  if(!rxPending) {
+    return FPS_RX_OK;
+  }
+
+  if(!rxCancelled) {
+    #ifdef FPS_DEBUG
+      debugPort.println(F("A response is still being received. Poll it before sending a command."));
+    #endif
+    return FPS_RX_PENDING;
+  }
 
-    timeout--;
+  while(pollPacket() == FPS_RX_PENDING) {
     delay(1);
   }
 
+  return FPS_RX_OK;
+}
+
+//=========================================================================//
+//send a command and start waiting for its response without blocking
+
+uint8_t R30X_FPS::beginCommand (uint8_t command, uint8_t* data, uint16_t dataLength, uint32_t timeout) {
+  uint8_t response = sendPacket(FPS_ID_COMMANDPACKET, command, data, dataLength);
+
+  if(response != FPS_RX_OK) {
+    return response;
+  }
+
+  beginReceive(timeout);
+  return FPS_RX_OK;
+}
+
+//=========================================================================//
+//check the received frame for errors and extract the values
+
+uint8_t R30X_FPS::checkFrame (void) {
+  rxDataBuffer = rxFrameBuffer + FPS_FRAME_HEADER_LENGTH + 1; //the data is read in place, right after the confirmation code
+
+  uint8_t* serialBuffer = rxFrameBuffer; //serialBuffer will store high byte at the start of the array
+  uint16_t serialBufferLength = rxFrameLength;
+
   if(serialBufferLength == 0) {
     #ifdef FPS_DEBUG
       debugPort.println(F("Serial timed out."));
@@ -423,7 +750,17 @@ uint8_t R30X_FPS::receivePacket (uint32_t timeout) {
           rxPacketLength[1] = serialBuffer[token];  //higher byte
           rxPacketLengthL = uint16_t(rxPacketLength[1] << 8) + rxPacketLength[0]; //calculate the full length value
           rxDataBufferLength = rxPacketLengthL - 3; //subtract 2 for checksum and 1 for command
+          rxDataChecksum = 0;
           token++; //because we read one additional bytes here
+
+          //the length must at least cover the code and checksum, and the whole packet must have been received
+          if((rxPacketLengthL < 3) || (rxDataBufferLength > FPS_MAX_DATA_LENGTH) || ((FPS_FRAME_HEADER_LENGTH + rxPacketLengthL) > serialBufferLength)) {
+            #ifdef FPS_DEBUG
+              debugPort.println(F("Error at 7 : Bad Packet Length"));
+            #endif
+
+            return FPS_RX_BADPACKET;
+          }
           break;
         }
 
@@ -448,9 +785,8 @@ uint8_t R30X_FPS::receivePacket (uint32_t timeout) {
         break;
 
       case 10: //read data
-        for(int i=0; i < rxDataBufferLength; i++) {
-          rxDataBuffer[(rxDataBufferLength - 1) - i] = serialBuffer[token + i]; //store low values at start of the rxDataBuffer array
-        }
+        //the data is already in place. only its sum is needed
+        rxDataChecksum = copyWithChecksum(NULL, serialBuffer + token, rxDataBufferLength);
         break;
       
       case 11: //read checksum
@@ -561,10 +897,7 @@ uint8_t R30X_FPS::receivePacket (uint32_t timeout) {
           uint16_t tempSum = 0; //temp checksum 
 
           tempSum = rxPacketType + rxPacketLength[0] + rxPacketLength[1] + rxConfirmationCode;
-
-          for(int i=0; i < rxDataBufferLength; i++) {
-            tempSum += rxDataBuffer[i]; //calculate data checksum
-          }
+          tempSum += rxDataChecksum;  //data checksum was calculated while copying
 
           if(rxPacketChecksumL == tempSum) { //check if the calculated checksum matches the received one
             #ifdef FPS_DEBUG
@@ -593,7 +926,7 @@ uint8_t R30X_FPS::receivePacket (uint32_t timeout) {
               debugPort.print(F("Data stream = "));
 
               for(int i=0; i < rxDataBufferLength; i++) {
-                debugPort.print(rxDataBuffer[(rxDataBufferLength-1) - i], HEX);
+                debugPort.print(rxDataBuffer[i], HEX);
                 if(i != (rxDataBufferLength - 1)) {
                   debugPort.print(F("-"));
                 }
@@ -643,7 +976,7 @@ uint8_t R30X_FPS::receivePacket (uint32_t timeout) {
               debugPort.print(F("Data stream = "));
 
               for(int i=0; i < rxDataBufferLength; i++) {
-                debugPort.print(rxDataBuffer[(rxDataBufferLength-1) - i], HEX);
+                debugPort.print(rxDataBuffer[i], HEX);
                 if(i != (rxDataBufferLength - 1)) {
                   debugPort.print(F("-"));
                 }
@@ -695,576 +1028,575 @@ uint8_t R30X_FPS::receivePacket (uint32_t timeout) {
 }
 
 //=========================================================================//
-//verify if the password set by user is correct
+//start assembling a new frame
 
-uint8_t R30X_FPS::verifyPassword (uint32_t inputPassword) {
-  uint8_t inputPasswordBytes[4] = {0};  //to store the split password
-  inputPasswordBytes[0] = inputPassword & 0xFFU;  //save each bytes
-  inputPasswordBytes[1] = (inputPassword >> 8) & 0xFFU;
-  inputPasswordBytes[2] = (inputPassword >> 16) & 0xFFU;
-  inputPasswordBytes[3] = (inputPassword >> 24) & 0xFFU;
+void R30X_FPS::resetFrame (void) {
+  rxFrameLength = 0;
+  rxFrameExpectedLength = FPS_FRAME_HEADER_LENGTH; //until the packet length is known
+}
 
-  sendPacket(FPS_ID_COMMANDPACKET, FPS_CMD_VERIFYPASSWORD, inputPasswordBytes, 4); //send the command and data
+//=========================================================================//
+//read the available bytes into the frame buffer, but not more than what the
+//current frame needs. returns true when the frame is complete
 
-  uint8_t response = receivePacket(); //read response
-  if(response == FPS_RX_OK) { //if the response packet is valid
-    if(rxConfirmationCode == FPS_RESP_OK) {
-      //save the input password if it is correct
-      //this is actually redundant, but can make sure the right password is available to execute further commands
-      devicePasswordL = inputPassword;
-      devicePassword[0] = inputPasswordBytes[0]; //save the new password as array
-      devicePassword[1] = inputPasswordBytes[1];
-      devicePassword[2] = inputPasswordBytes[2];
-      devicePassword[3] = inputPasswordBytes[3];
+bool R30X_FPS::readFrame (void) {
+  #ifdef FPS_RX_EVENTS
+    if(rxEventSemaphore != NULL) {  //the receive callback moves the bytes to the ring
+      while(!readFrameFrom(FPS_RingPort(&rxRing))) {
+        fillRing(); //the ring is empty. take what the callback left in the UART
 
-      #ifdef FPS_DEBUG
-        debugPort.println(F("Password is correct."));
-        debugPort.print(F("Current Password = "));
-        debugPort.println(devicePasswordL, HEX);
-      #endif
+        if(rxRing.available() == 0) {
+          return false;
+        }
+      }
 
-      return FPS_RESP_OK; //password is correct
+      return true;
     }
-    else {
-      #ifdef FPS_DEBUG
-        debugPort.println(F("Password is not correct."));
-        debugPort.print(F("Tested Password = "));
-        debugPort.println(inputPassword, HEX);
-        debugPort.print(F("rxConfirmationCode = "));
-        debugPort.println(rxConfirmationCode, HEX);
-      #endif
+  #endif
 
-      return rxConfirmationCode;  //password is not correct and so send confirmation code
+  #ifdef FPS_DIRECT_PORT
+    if(hwSerial != NULL) {
+      return readFrameFrom(FPS_HardwarePort(hwSerial));
     }
-  }
-  else {
-    return response; //return packet receive error code
-  }
+
+    #if defined(__AVR__)
+      if(swSerial != NULL) {
+        return readFrameFrom(FPS_SoftwarePort(swSerial));
+      }
+    #endif
+  #endif
+
+  return readFrameFrom(FPS_StreamPort(mySerial));
 }
 
 //=========================================================================//
-//set a new 4 byte password
+//the byte loop of readFrame(), compiled for each type of port. with a port
+//of known type, the calls in the loop can be inlined instead of going through
+//the virtual functions of Stream for every byte
 
-uint8_t R30X_FPS::setPassword (uint32_t inputPassword) {
-  uint8_t inputPasswordBytes[4] = {0};
-  inputPasswordBytes[0] = inputPassword & 0xFFU;
-  inputPasswordBytes[1] = (inputPassword >> 8) & 0xFFU;
-  inputPasswordBytes[2] = (inputPassword >> 16) & 0xFFU;
-  inputPasswordBytes[3] = (inputPassword >> 24) & 0xFFU;
+template <class Port> bool R30X_FPS::readFrameFrom (Port port) {
+  while(rxFrameLength < rxFrameExpectedLength) {
+    int availableCount = port.available();  //one call for the whole batch
 
-  sendPacket(FPS_ID_COMMANDPACKET, FPS_CMD_SETPASSWORD, inputPasswordBytes, 4); //send the command and data
-  uint8_t response = receivePacket(); //read response
+    if(availableCount <= 0) {
+      break;
+    }
 
-  if(response == FPS_RX_OK) { //if the response packet is valid
-    if(rxConfirmationCode == FPS_RESP_OK) { //the confrim code will be saved when the response is received
-      devicePasswordL = inputPassword; //save the new password (Long)
-      devicePassword[0] = inputPasswordBytes[0]; //save the new password as array
-      devicePassword[1] = inputPasswordBytes[1];
-      devicePassword[2] = inputPasswordBytes[2];
-      devicePassword[3] = inputPasswordBytes[3];
+    while((availableCount > 0) && (rxFrameLength < rxFrameExpectedLength)) {
+      rxFrameBuffer[rxFrameLength] = port.read();
+      availableCount--;
 
-      #ifdef FPS_DEBUG
-        debugPort.println(F("Setting password successful."));
-        debugPort.print(F("New password = "));
-        debugPort.println(devicePasswordL, HEX);
-      #endif
+      if((rxFrameLength == 0) && (rxFrameBuffer[0] == FPS_ID_POWERON)) { //not a start code, the module was reset
+        endSession();
+        continue;
+      }
 
-      return FPS_RESP_OK; //password setting complete
-    }
-    else {
-      #ifdef FPS_DEBUG
-        debugPort.println(F("Setting password failed."));
-        debugPort.print(F("Input Password = "));
-        debugPort.println(inputPassword, HEX);
-        debugPort.print(F("rxConfirmationCode = "));
-        debugPort.println(rxConfirmationCode, HEX);
-      #endif
-      return rxConfirmationCode;  //setting was unsuccessful and so send confirmation code
+      rxFrameLength++;
+
+      if(rxFrameLength == FPS_FRAME_HEADER_LENGTH) { //header + packet length bytes are received
+        rxFrameExpectedLength = FPS_FRAME_HEADER_LENGTH + ((uint16_t(rxFrameBuffer[7]) << 8) | rxFrameBuffer[8]);
+
+        if(rxFrameExpectedLength > FPS_DEFAULT_SERIAL_BUFFER_LENGTH) { //can not hold more than this
+          rxFrameExpectedLength = FPS_DEFAULT_SERIAL_BUFFER_LENGTH;
+        }
+      }
     }
+
+    #ifdef FPS_STATS
+      if(awaitingAck && (statsFirstByteTime == 0)) {
+        statsFirstByteTime = millis();
+      }
+    #endif
   }
-  else {
-    return response; //return packet receive error code
-  }
+
+  return (rxFrameLength >= rxFrameExpectedLength);
 }
 
 //=========================================================================//
-//set a new 4 byte device address. if the operation is successful, the new
-//address will be saved
+//on ESP32, the UART driver calls back when data is received. the callback
+//copies the data to rxRing and wakes up the task waiting in receivePacket().
+//this way the task sleeps instead of polling the port during long transfers,
+//and doesn't take the lock of the UART driver for every byte
+
+#ifdef FPS_RX_EVENTS
+  void R30X_FPS::attachReceiveEvent (void) {
+    if(hwSerial == NULL) {
+      return;
+    }
 
-uint8_t R30X_FPS::setAddress (uint32_t address) {
-  uint8_t addressArray[4] = {0}; //just so that we do not need to alter the existing address before successfully changing it
-  addressArray[0] = address & 0xFF;
-  addressArray[1] = (address >> 8) & 0xFF;
-  addressArray[2] = (address >> 16) & 0xFF;
-  addressArray[3] = (address >> 24) & 0xFF;
+    if(rxEventSemaphore == NULL) {
+      rxEventSemaphore = xSemaphoreCreateBinary();
+    }
 
-  sendPacket(FPS_ID_COMMANDPACKET, FPS_CMD_SETDEVICEADDRESS, addressArray, 4); //send the command and data
+    rxRing.clear(); //the port was just started, so the callback is not running
 
-  deviceAddressL = address; //save the new address (Long)
-  deviceAddress[0] = addressArray[0]; //save the new address as array
-  deviceAddress[1] = addressArray[1];
-  deviceAddress[2] = addressArray[2];
-  deviceAddress[3] = addressArray[3];
+    hwSerial->onReceive([this]() {
+      fillRing();
+      xSemaphoreGive(rxEventSemaphore); //even if the task was filling, so it looks again
+    });
+  }
 
-  uint8_t response = receivePacket(); //read response
+  //=========================================================================//
+  //move the received bytes from the UART to rxRing, but only as many as the
+  //ring can hold. the rest stays in the buffer of the UART driver until the
+  //receiving task has made room, and it fills the ring itself when it finds
+  //the ring empty. only one side fills at a time, so the bytes stay in order.
+  //the other side doesn't wait for the lock, it just leaves the filling to
+  //the side that has it
+
+  void R30X_FPS::fillRing (void) {
+    if(__atomic_test_and_set(&rxFillLock, __ATOMIC_ACQUIRE)) {
+      return;
+    }
 
-  if(response == FPS_RX_OK) { //if the response packet is valid
-    if((rxConfirmationCode == FPS_RESP_OK) || (rxConfirmationCode == 0x20U)) { //the confrim code will be saved when the response is received
-      #ifdef FPS_DEBUG
-        debugPort.println(F("Setting address successful."));
-        debugPort.print(F("New address = "));
-        debugPort.println(deviceAddressL, HEX);
-      #endif
+    uint8_t chunk[64];
 
-      return FPS_RESP_OK; //address setting complete
-    }
-    else {
-      #ifdef FPS_DEBUG
-        debugPort.println(F("Setting address failed."));
-        debugPort.print(F("rxConfirmationCode = "));
-        debugPort.println(rxConfirmationCode, HEX);
-      #endif
-      return rxConfirmationCode;  //setting was unsuccessful and so send confirmation code
+    while(true) {
+      int length = hwSerial->available();
+
+      if(length > rxRing.space()) {
+        length = rxRing.space();
+      }
+
+      if(length > int(sizeof(chunk))) {
+        length = sizeof(chunk);
+      }
+
+      if(length <= 0) {
+        break;
+      }
+
+      length = hwSerial->read(chunk, length);
+
+      if(length <= 0) {
+        break;
+      }
+
+      rxRing.write(chunk, length);
     }
+
+    __atomic_clear(&rxFillLock, __ATOMIC_RELEASE);
   }
-  else {
-    return response; //return packet receive error code
+
+  //=========================================================================//
+  //add bytes to the ring. only the holder of the fill lock calls this. the
+  //bytes are written before head is moved, so the reader never sees a byte
+  //that isn't written yet
+
+  uint16_t FPS_ByteRing::write (const uint8_t* data, uint16_t length) {
+    uint16_t writeIndex = head;
+    uint16_t freeLength = space();
+
+    if(length > freeLength) {
+      length = freeLength;
+    }
+
+    for(uint16_t i=0; i < length; i++) {
+      buffer[(writeIndex + i) & (FPS_RX_RING_LENGTH - 1)] = data[i];
+    }
+
+    __atomic_store_n(&head, uint16_t(writeIndex + length), __ATOMIC_RELEASE);
+    return length;
   }
-}
 
-//=========================================================================//
-//change the baudrate and reinitialize the port. the new baudrate will be
-//saved after successful execution
+  //=========================================================================//
+  //no. of bytes that can be added to the ring
 
-uint8_t R30X_FPS::setBaudrate (uint32_t baud) {
-  uint8_t baudNumber = baud / 9600; //check if the baudrate is a multiple of 9600
-  uint8_t dataArray[2] = {0};
+  uint16_t FPS_ByteRing::space (void) {
+    return FPS_RX_RING_LENGTH - uint16_t(head - __atomic_load_n(&tail, __ATOMIC_ACQUIRE));
+  }
 
-  #ifdef FPS_DEBUG
-    debugPort.print(F("Input baudrate = "));
-    debugPort.println(baud);
-    debugPort.print(F("Baud number = "));
-    debugPort.println(baudNumber);
-  #endif
+  //=========================================================================//
+  //no. of bytes waiting in the ring
 
-  if((baudNumber > 0) && (baudNumber < 13)) { //should be between 1 (9600bps) and 12 (115200bps)
-    dataArray[0] = baudNumber;  //low byte
-    dataArray[1] = 4; //the code for the system parameter number, 4 means baudrate
+  int FPS_ByteRing::available (void) {
+    return uint16_t(__atomic_load_n(&head, __ATOMIC_ACQUIRE) - tail);
+  }
 
-    sendPacket(FPS_ID_COMMANDPACKET, FPS_CMD_SETSYSPARA, dataArray, 2); //send the command and data
-    uint8_t response = receivePacket(); //read response
+  //=========================================================================//
+  //take a byte from the ring. the slot is given back to the writer only after
+  //the byte is read from it
 
-    if(response == FPS_RX_OK) { //if the response packet is valid
-      if(rxConfirmationCode == FPS_RESP_OK) { //the confirm code will be saved when the response is received
-        deviceBaudrate = baud;
-        
-        reinitializePort(deviceBaudrate);
+  int FPS_ByteRing::read (void) {
+    uint16_t readIndex = tail;
 
-        #ifdef FPS_DEBUG
-          debugPort.println(F("Setting baudrate successful."));
-        #endif
-        return FPS_RESP_OK; //baudrate setting complete
-      }
-      else {
-        #ifdef FPS_DEBUG
-          debugPort.println(F("Setting baudrate failed."));
-          debugPort.print(F("rxConfirmationCode = "));
-          debugPort.println(rxConfirmationCode, HEX);
-        #endif
-        return rxConfirmationCode;  //setting was unsuccessful and so send confirmation code
-      }
-    }
-    else {
-      return response; //return packet receive error code
+    if(__atomic_load_n(&head, __ATOMIC_ACQUIRE) == readIndex) {
+      return -1;
     }
+
+    uint8_t data = buffer[readIndex & (FPS_RX_RING_LENGTH - 1)];
+    __atomic_store_n(&tail, uint16_t(readIndex + 1), __ATOMIC_RELEASE);
+    return data;
   }
-  else {
-    #ifdef FPS_DEBUG
-      debugPort.println(F("Bad baudrate value."));
-      debugPort.println(F("Setting baudrate failed."));
-    #endif
-    return FPS_BAD_VALUE;
+
+  //=========================================================================//
+  //discard everything in the ring
+
+  void FPS_ByteRing::clear (void) {
+    __atomic_store_n(&tail, __atomic_load_n(&head, __ATOMIC_ACQUIRE), __ATOMIC_RELEASE);
   }
-}
+#endif
 
 //=========================================================================//
-//reinitializes the serial port with a new baud rate, without changing the
-//device configuration. this is useful when you don't already know the
-//device's configured baud rate
+//command statistics and timings are kept in the same order as this table
+
+const uint8_t commandCodes[FPS_STATS_COMMAND_COUNT] PROGMEM = {
+  FPS_CMD_SCANFINGER, FPS_CMD_IMAGETOCHARACTER, FPS_CMD_MATCHTEMPLATES, FPS_CMD_SEARCHLIBRARY,
+  FPS_CMD_GENERATETEMPLATE, FPS_CMD_STORETEMPLATE, FPS_CMD_LOADTEMPLATE, FPS_CMD_EXPORTTEMPLATE,
+  FPS_CMD_IMPORTTEMPLATE, FPS_CMD_EXPORTIMAGE, FPS_CMD_IMPORTIMAGE, FPS_CMD_DELETETEMPLATE,
+  FPS_CMD_CLEARLIBRARY, FPS_CMD_SETSYSPARA, FPS_CMD_READSYSPARA, FPS_CMD_SETPASSWORD,
+  FPS_CMD_VERIFYPASSWORD, FPS_CMD_GETRANDOMCODE, FPS_CMD_SETDEVICEADDRESS, FPS_CMD_PORTCONTROL,
+  FPS_CMD_WRITENOTEPAD, FPS_CMD_READNOTEPAD, FPS_CMD_HISPEEDSEARCH, FPS_CMD_TEMPLATECOUNT,
+  FPS_CMD_SCANANDRANGESEARCH, FPS_CMD_SCANANDFULLSEARCH, FPS_CMD_READINDEXTABLE
+};
 
-uint8_t R30X_FPS::reinitializePort(uint32_t baud) {
-  if(hwSerial) { //if using hardware serial
-    hwSerial->end();  //end the existing serial port
-    hwSerial->begin(baud);  //restart the port with new baudrate
-  }
+//=========================================================================//
+//returns the position of a command in commandCodes, or -1 if it's unknown
 
-  #if defined(__AVR__) || defined(ESP8266)
-    if (swSerial) { //if using software serial
-      swSerial->end();  //stop existing serial port
-      swSerial->begin(baud);  //restart the port with new baudrate
+int8_t R30X_FPS::getCommandIndex (uint8_t command) {
+  for(uint8_t i=0; i < FPS_STATS_COMMAND_COUNT; i++) {
+    if(pgm_read_byte(&commandCodes[i]) == command) {
+      return i;
     }
-  #endif
+  }
 
-  #ifdef FPS_DEBUG
-    debugPort.println(F("Reinitialized port."));
-  #endif
+  return -1;
 }
 
+#ifdef FPS_ADAPTIVE_TIMEOUT
+
 //=========================================================================//
-//change the security level - or the threshold for matching two fingerprint
-//templates
+//returns the timeout for the acknowledgement of a command. once the response
+//time of the command is known, the timeout is the average time plus four times
+//its average deviation, the same way TCP works out its retransmission timeout,
+//with some margin added. until then, FPS_DEFAULT_TIMEOUT is used. each timeout
+//in a row doubles it
+
+uint32_t R30X_FPS::getTimeout (uint8_t command) {
+  switch(command) {
+    case FPS_CMD_CLEARLIBRARY:  //depends on how many templates are erased
+    case FPS_CMD_DELETETEMPLATE:
+    case FPS_CMD_SEARCHLIBRARY: //depends on how many templates are searched
+    case FPS_CMD_HISPEEDSEARCH:
+    case FPS_CMD_SCANANDRANGESEARCH:
+    case FPS_CMD_SCANANDFULLSEARCH:
+      return FPS_LONG_TIMEOUT;
+  }
 
-uint8_t R30X_FPS::setSecurityLevel (uint8_t level) {
-  uint8_t dataArray[2] = {0};
+  int8_t index = getCommandIndex(command);
 
-  if((level > 0) && (level < 6)) { //should be between 1 and 5
-    dataArray[0] = level;  //low byte
-    dataArray[1] = 5; //the code for the system parameter number, 5 means the security level
+  if(index < 0) {
+    return FPS_DEFAULT_TIMEOUT;
+  }
 
-    sendPacket(FPS_ID_COMMANDPACKET, FPS_CMD_SETSYSPARA, dataArray, 2); //send the command and data
-    uint8_t response = receivePacket(); //read response
+  FPS_CommandTiming* timing = &commandTiming[index];
+  uint32_t timeout = FPS_DEFAULT_TIMEOUT;
 
-    if(response == FPS_RX_OK) { //if the response packet is valid
-      if(rxConfirmationCode == FPS_RESP_OK) { //the confirm code will be saved when the response is received
-        #ifdef FPS_DEBUG
-          debugPort.println(F("Setting new security level successful."));
-          debugPort.print(F("Old value = "));
-          debugPort.println(securityLevel, HEX);
-          debugPort.print(F("New value = "));
-          debugPort.println(level, HEX);
-        #endif
-        securityLevel = level;  //save new value
-        return FPS_RESP_OK; //security level setting complete
-      }
-      else {
-        #ifdef FPS_DEBUG
-          debugPort.println(F("Setting security level failed."));
-          debugPort.print(F("Current value = "));
-          debugPort.println(securityLevel, HEX);
-          debugPort.print(F("rxConfirmationCode = "));
-          debugPort.println(rxConfirmationCode, HEX);
-        #endif
-        return rxConfirmationCode;  //setting was unsuccessful and so send confirmation code
-      }
-    }
-    else {
-      return response; //return packet receive error code
+  if(timing->smoothedTime != 0) {
+    timeout = (timing->smoothedTime >> 3) + timing->timeVariance; //the variance is already x4
+    timeout = (timeout * FPS_TIMEOUT_MARGIN) / 100;
+
+    if(timeout < FPS_MIN_TIMEOUT) {
+      timeout = FPS_MIN_TIMEOUT;
     }
   }
-  else {
-    #ifdef FPS_DEBUG
-      debugPort.println(F("Bad security level value."));
-      debugPort.println(F("Setting security level failed."));
-    #endif
-    return FPS_BAD_VALUE; //the received parameter is invalid
+
+  timeout <<= timing->backoff;
+
+  if(timeout > FPS_MAX_TIMEOUT) {
+    timeout = FPS_MAX_TIMEOUT;
   }
+
+  return timeout;
 }
 
 //=========================================================================//
-//set the max length of data bytes that can be received from the module
+//forget the learned response times, eg. after changing the baudrate
 
-uint8_t R30X_FPS::setDataLength (uint16_t length) {
-   #ifdef FPS_DEBUG
-    debugPort.println(F("Setting new data length.."));
-  #endif
+void R30X_FPS::resetTimeouts (void) {
+  memset(commandTiming, 0, sizeof(commandTiming));
+}
 
-  uint8_t dataArray[2] = {0};
+//=========================================================================//
+//add the response time of the last command to its average. a timeout backs
+//off the timeout of the command until it gets a response again
 
-  if((length == 32) || (length == 64) || (length == 128) || (length == 256)) { //should be 32, 64, 128 or 256 bytes
-    if(length == 32)
-      dataArray[0] = 0;  //low byte
-    else if(length == 64)
-      dataArray[0] = 1;  //low byte
-    else if(length == 128)
-      dataArray[0] = 2;  //low byte
-    else if(length == 256)
-      dataArray[0] = 3;  //low byte
+void R30X_FPS::updateTimeout (uint8_t response) {
+  if(!awaitingAck) {
+    return;
+  }
 
-    dataArray[1] = 6; //the code for the system parameter number
-    sendPacket(FPS_ID_COMMANDPACKET, FPS_CMD_SETSYSPARA, dataArray, 2); //send the command and data
-    uint8_t response = receivePacket(); //read response
+  int8_t index = getCommandIndex(lastCommand);
 
-    if(response == FPS_RX_OK) { //if the response packet is valid
-      if(rxConfirmationCode == FPS_RESP_OK) { //the confirm code will be saved when the response is received
-        dataPacketLength = length;  //save the new data length
+  if(index < 0) {
+    return;
+  }
 
-        #ifdef FPS_DEBUG
-          debugPort.println(F("Setting data length successful."));
-          debugPort.print(F("dataPacketLength = "));
-          debugPort.println(dataPacketLength);
-        #endif
+  FPS_CommandTiming* timing = &commandTiming[index];
 
-        return FPS_RESP_OK; //length setting complete
-      }
-      else {
-        #ifdef FPS_DEBUG
-          debugPort.println(F("Setting data length failed."));
-          debugPort.print(F("rxConfirmationCode = "));
-          debugPort.println(rxConfirmationCode, HEX);
-        #endif
-        return rxConfirmationCode;  //setting was unsuccessful and so send confirmation code
-      }
-    }
-    else {
-      return response; //return packet receive error code
+  if(ackTimedOut) {
+    if(timing->backoff < FPS_TIMEOUT_MAX_BACKOFF) {
+      timing->backoff++;
     }
+    return;
   }
-  else {
-    #ifdef FPS_DEBUG
-      debugPort.println(F("Bad data length value."));
-      debugPort.println(F("Setting data length failed."));
-    #endif
-    return FPS_BAD_VALUE; //the received parameter is invalid
+
+  if(response != FPS_RX_OK) { //a bad packet says nothing about the time
+    return;
   }
-}
 
-//=========================================================================//
-//turns the communication port on/off
+  uint32_t sample = millis() - commandSendTime;
+  timing->backoff = 0;
 
-uint8_t R30X_FPS::portControl (uint8_t value) {
-  #ifdef FPS_DEBUG
-    if(value == 1)
-      debugPort.println(F("Turning on port.."));
-    else
-      debugPort.println(F("Turning off port.."));
-  #endif
+  if(sample > FPS_TIMEOUT_SAMPLE_LIMIT) {
+    sample = FPS_TIMEOUT_SAMPLE_LIMIT;
+  }
+  else if(sample == 0) {  //0 means not known
+    sample = 1;
+  }
 
-  uint8_t dataArray[1] = {0};
+  if(timing->smoothedTime == 0) { //the first response
+    timing->smoothedTime = sample << 3;
+    timing->timeVariance = sample << 1; //half of the time, x4
+    return;
+  }
 
-  if((value == 0) || (value == 1)) { //should be either 1 or 0
-    dataArray[0] = value;
-    sendPacket(FPS_ID_COMMANDPACKET, FPS_CMD_PORTCONTROL, dataArray, 1); //send the command and data
-    uint8_t response = receivePacket(); //read response
+  int16_t error = int16_t(sample) - int16_t(timing->smoothedTime >> 3);
+  timing->smoothedTime += error;  //moves 1/8 of the way to the new time
 
-    if(response == FPS_RX_OK) { //if the response packet is valid
-      if(rxConfirmationCode == FPS_RESP_OK) { //the confirm code will be saved when the response is received
-        #ifdef FPS_DEBUG
-          if(value == 1)
-            debugPort.println(F("Turning on port successful."));
-          else
-            debugPort.println(F("Turning off port successful."));
-        #endif
-        return FPS_RESP_OK; //port setting complete
-      }
-      else {
-        #ifdef FPS_DEBUG
-          debugPort.println(F("Turning on/off port failed."));
-          debugPort.print(F("rxConfirmationCode = "));
-          debugPort.println(rxConfirmationCode, HEX);
-        #endif
-        return rxConfirmationCode;  //setting was unsuccessful and so send confirmation code
-      }
-    }
-    else {
-      return response; //return packet receive error code
-    }
+  if(error < 0) {
+    error = -error;
   }
-  else {
-    return FPS_BAD_VALUE; //the received parameter is invalid
+
+  error -= (timing->timeVariance >> 2);
+  timing->timeVariance += error;  //moves 1/4 of the way to the new deviation
+}
+
+#endif
+
+#ifdef FPS_STATS
+
+//=========================================================================//
+//returns the statistics of a command, or NULL if the command is unknown
+
+FPS_CommandStats* R30X_FPS::getCommandStats (uint8_t command) {
+  int8_t index = getCommandIndex(command);
+
+  if(index < 0) {
+    return NULL;
   }
+
+  return &commandStats[index];
 }
 
 //=========================================================================//
-//read system configuration
+//clear all the statistics
 
-uint8_t R30X_FPS::readSysPara() {
-  #ifdef FPS_DEBUG
-    debugPort.println(F("Reading system parameters.."));
-  #endif
+void R30X_FPS::resetStats (void) {
+  memset(commandStats, 0, sizeof(commandStats));
+  memset(responseHistogram, 0, sizeof(responseHistogram));
 
-  sendPacket(FPS_ID_COMMANDPACKET, FPS_CMD_READSYSPARA); //send the command, there's no additional data
-  uint8_t response = receivePacket(); //read response
+  statsFirstByteTime = 0;
+}
 
-  if(response == FPS_RX_OK) { //if the response packet is valid
-    if(rxConfirmationCode == FPS_RESP_OK) { //the confirm code will be saved when the response is received
-      statusRegister = (uint16_t(rxDataBuffer[15]) << 8) + rxDataBuffer[14];  //high byte + low byte
-      systemID = (uint16_t(rxDataBuffer[13]) << 8) + rxDataBuffer[12];
-      librarySize = (uint16_t(rxDataBuffer[11]) << 8) + rxDataBuffer[10];
-      securityLevel = (uint16_t(rxDataBuffer[9]) << 8) + rxDataBuffer[8];
+//=========================================================================//
+//account the result of receivePacket() to the last command sent. timings are
+//only taken for the acknowledgement, and not for the data packets after it
 
-      deviceAddressL = (uint32_t(rxDataBuffer[7]) << 24) + (uint32_t(rxDataBuffer[6]) << 16) + (uint32_t(rxDataBuffer[5]) << 8) + uint32_t(rxDataBuffer[4]);
-      
-      dataPacketLengthCode = (uint16_t(rxDataBuffer[3]) << 8) + rxDataBuffer[2];
-      baudMultiplier = (uint16_t(rxDataBuffer[1]) << 8) + rxDataBuffer[0];
+void R30X_FPS::updateStats (uint8_t response) {
+  FPS_CommandStats* stats = getCommandStats(lastCommand);
 
-      if(dataPacketLengthCode == 0)
-        dataPacketLength = 32;
-      else if(dataPacketLengthCode == 1)
-        dataPacketLength = 64;
-      else if(dataPacketLengthCode == 2)
-        dataPacketLength = 128;
-      else if(dataPacketLengthCode == 3)
-        dataPacketLength = 256;
+  if(stats == NULL) {
+    return;
+  }
 
-      deviceBaudrate = uint32_t(baudMultiplier * 9600);  //baudrate is retrieved as a multiplier
+  stats->bytesReceived += rxFrameLength;
 
-      #ifdef FPS_DEBUG
-        debugPort.println(F("Reading system parameters successful."));
-        debugPort.print(F("statusRegister = 0x"));
-        debugPort.println(statusRegister, HEX);
-        debugPort.print(F("systemID = 0x"));
-        debugPort.println(systemID, HEX);
-        debugPort.print(F("librarySize = "));
-        debugPort.println(librarySize);
-        debugPort.print(F("securityLevel = 0x"));
-        debugPort.println(securityLevel, HEX);
-        debugPort.print(F("deviceAddressL = 0x"));
-        debugPort.println(deviceAddressL, HEX);
-        debugPort.print(F("dataPacketLengthCode = 0x"));
-        debugPort.println(dataPacketLengthCode, HEX);
-        debugPort.print(F("baudMultiplier = 0x"));
-        debugPort.println(baudMultiplier, HEX);
-        debugPort.print(F("deviceBaudrate = "));
-        debugPort.print(deviceBaudrate);
-        debugPort.println(F(" bps"));
-      #endif
+  if(response == FPS_RX_TIMEOUT) {
+    stats->timeouts++;
+  }
+  else if(response != FPS_RX_OK) {
+    stats->errors++;
+  }
 
-      return FPS_RESP_OK;
-    }
-    else {
-      #ifdef FPS_DEBUG
-        debugPort.println(F("Reading system parameters failed."));
-        debugPort.print(F("rxConfirmationCode = "));
-        debugPort.println(rxConfirmationCode, HEX);
-      #endif
-      return rxConfirmationCode;  //setting was unsuccessful and so send confirmation code
-    }
+  if(!awaitingAck) {
+    return;
   }
-  else {
-    return response; //return packet receive error code
+
+  if(response != FPS_RX_OK) {
+    return;
   }
-}
 
-//=========================================================================//
-//returns the total template count in the flash memory
+  uint32_t completeTime = millis() - commandSendTime;
+  uint32_t firstByteTime = (statsFirstByteTime != 0) ? (statsFirstByteTime - commandSendTime) : completeTime;
 
-uint8_t R30X_FPS::getTemplateCount() {
-  #ifdef FPS_DEBUG
-    debugPort.println(F("Reading template count.."));
-  #endif
+  stats->firstByteTimeTotal += firstByteTime;
+  stats->completeTimeTotal += completeTime;
+  stats->responses++;
 
-  sendPacket(FPS_ID_COMMANDPACKET, FPS_CMD_TEMPLATECOUNT); //send the command, there's no additional data
-  uint8_t response = receivePacket(); //read response
+  if(firstByteTime > stats->firstByteTimeMax) {
+    stats->firstByteTimeMax = firstByteTime;
+  }
 
-  if(response == FPS_RX_OK) { //if the response packet is valid
-    if(rxConfirmationCode == FPS_RESP_OK) { //the confirm code will be saved when the response is received
-      templateCount = (uint16_t(rxDataBuffer[1]) << 8) + rxDataBuffer[0];  //high byte + low byte
+  if(completeTime > stats->completeTimeMax) {
+    stats->completeTimeMax = completeTime;
+  }
 
-      #ifdef FPS_DEBUG
-        debugPort.println(F("Reading template count successful."));
-        debugPort.print(F("templateCount = "));
-        debugPort.println(templateCount);
-      #endif
+  if(rxConfirmationCode == FPS_RESP_OK) {
+    stats->okCount++;
+  }
 
-      return FPS_RESP_OK;
-    }
-    else {
-      #ifdef FPS_DEBUG
-        debugPort.println(F("Reading template count failed."));
-        debugPort.print(F("rxConfirmationCode = "));
-        debugPort.println(rxConfirmationCode, HEX);
-      #endif
-      return rxConfirmationCode;  //setting was unsuccessful and so send confirmation code
-    }
+  if(rxConfirmationCode < FPS_STATS_RESPONSE_CODES) {
+    responseHistogram[rxConfirmationCode]++;
   }
-  else {
-    return response; //return packet receive error code
+}
+
+//=========================================================================//
+//print a metric line in Prometheus text format. the label value is a hex code
+
+void R30X_FPS::printMetric (Print& output, const __FlashStringHelper* name, const __FlashStringHelper* label, uint8_t code, uint32_t value) {
+  output.print(name);
+  output.print(F("{"));
+  output.print(label);
+  output.print(F("=\"0x"));
+  if(code < 0x10) {
+    output.print(F("0"));
   }
+  output.print(code, HEX);
+  output.print(F("\"} "));
+  output.println(value);
 }
 
 //=========================================================================//
-//scans the fingerprint and finds a match within specified range
-//timeout = 100-25500 milliseconds
-//startId = #1-#1000
-//range = 1-1000
+//returns a field of the statistics of a command, by its FPS_STATS_* no.
+
+uint32_t R30X_FPS::getStatsField (const FPS_CommandStats* stats, uint8_t field) {
+  switch(field) {
+    case FPS_STATS_COUNT: return stats->count;
+    case FPS_STATS_OK_COUNT: return stats->okCount;
+    case FPS_STATS_RESPONSES: return stats->responses;
+    case FPS_STATS_FIRST_BYTE_TOTAL: return stats->firstByteTimeTotal;
+    case FPS_STATS_FIRST_BYTE_MAX: return stats->firstByteTimeMax;
+    case FPS_STATS_COMPLETE_TOTAL: return stats->completeTimeTotal;
+    case FPS_STATS_COMPLETE_MAX: return stats->completeTimeMax;
+    case FPS_STATS_BYTES_SENT: return stats->bytesSent;
+    case FPS_STATS_BYTES_RECEIVED: return stats->bytesReceived;
+    case FPS_STATS_RETRIES: return stats->retries;
+    case FPS_STATS_TIMEOUTS: return stats->timeouts;
+    case FPS_STATS_ERRORS: return stats->errors;
+    default: return 0;
+  }
+}
 
-uint8_t R30X_FPS::captureAndRangeSearch (uint16_t captureTimeout, uint16_t startLocation, uint16_t count) {
-  if(captureTimeout > 25500) { //25500 is the max timeout the device supports
-    #ifdef FPS_DEBUG
-      debugPort.println(F("Capture and range search failed."));
-      debugPort.println(F("Bad capture timeout."));
-      debugPort.print(F("captureTimeout = "));
-      debugPort.println(captureTimeout);
-    #endif
-    return FPS_BAD_VALUE;
+//=========================================================================//
+//print the TYPE line of a metric family and then a line for each command that
+//was used. a summary has two lines per command, so the second one is printed
+//with no TYPE line to keep it in the same family
+
+void R30X_FPS::printFamily (Print& output, const __FlashStringHelper* typeLine, const __FlashStringHelper* name, uint8_t field) {
+  if(typeLine != NULL) {
+    output.println(typeLine);
   }
 
-  if((startLocation > 1000) || (startLocation < 1)) { //if not in range (0-999)
-    #ifdef FPS_DEBUG
-      debugPort.println(F("Capture and range search failed."));
-      debugPort.println(F("Bad start ID"));
-      debugPort.print(F("startId = #"));
-      debugPort.println(startLocation);
-    #endif
+  for(uint8_t i=0; i < FPS_STATS_COMMAND_COUNT; i++) {
+    FPS_CommandStats* stats = &commandStats[i];
 
-    return FPS_BAD_VALUE;
+    if(stats->count == 0) { //skip the commands never used
+      continue;
+    }
+
+    printMetric(output, name, F("command"), pgm_read_byte(&commandCodes[i]), getStatsField(stats, field));
   }
+}
 
-  if((startLocation + count) > 1001) { //if range overflows
-    #ifdef FPS_DEBUG
-      debugPort.println(F("Capture and range search failed."));
-      debugPort.println(F("startLocation + count can't be greater than 1001."));
-      debugPort.print(F("startLocation = #"));
-      debugPort.println(startLocation);
-      debugPort.print(F("count = "));
-      debugPort.println(count);
-      debugPort.print(F("startLocation + count = "));
-      debugPort.println(startLocation + count);
-    #endif
-    return FPS_BAD_VALUE;
+//=========================================================================//
+//print all the statistics in Prometheus text format so that they can be
+//served to a metrics scraper, or just printed to the serial monitor. all the
+//lines of a metric family follow its TYPE line
+
+void R30X_FPS::printStats (Print& output) {
+  printFamily(output, F("# TYPE fps_command_total counter"), F("fps_command_total"), FPS_STATS_COUNT);
+  printFamily(output, F("# TYPE fps_command_ok_total counter"), F("fps_command_ok_total"), FPS_STATS_OK_COUNT);
+  printFamily(output, F("# TYPE fps_command_first_byte_ms summary"), F("fps_command_first_byte_ms_sum"), FPS_STATS_FIRST_BYTE_TOTAL);
+  printFamily(output, NULL, F("fps_command_first_byte_ms_count"), FPS_STATS_RESPONSES);
+  printFamily(output, F("# TYPE fps_command_first_byte_ms_max gauge"), F("fps_command_first_byte_ms_max"), FPS_STATS_FIRST_BYTE_MAX);
+  printFamily(output, F("# TYPE fps_command_complete_ms summary"), F("fps_command_complete_ms_sum"), FPS_STATS_COMPLETE_TOTAL);
+  printFamily(output, NULL, F("fps_command_complete_ms_count"), FPS_STATS_RESPONSES);
+  printFamily(output, F("# TYPE fps_command_complete_ms_max gauge"), F("fps_command_complete_ms_max"), FPS_STATS_COMPLETE_MAX);
+  printFamily(output, F("# TYPE fps_command_bytes_sent_total counter"), F("fps_command_bytes_sent_total"), FPS_STATS_BYTES_SENT);
+  printFamily(output, F("# TYPE fps_command_bytes_received_total counter"), F("fps_command_bytes_received_total"), FPS_STATS_BYTES_RECEIVED);
+  printFamily(output, F("# TYPE fps_command_retries_total counter"), F("fps_command_retries_total"), FPS_STATS_RETRIES);
+  printFamily(output, F("# TYPE fps_command_timeouts_total counter"), F("fps_command_timeouts_total"), FPS_STATS_TIMEOUTS);
+  printFamily(output, F("# TYPE fps_command_errors_total counter"), F("fps_command_errors_total"), FPS_STATS_ERRORS);
+
+  output.println(F("# TYPE fps_response_total counter"));
+
+  for(uint8_t i=0; i < FPS_STATS_RESPONSE_CODES; i++) {
+    if(responseHistogram[i] > 0) {
+      printMetric(output, F("fps_response_total"), F("code"), i, responseHistogram[i]);
+    }
   }
+}
+#endif
 
-  uint8_t dataArray[5] = {0}; //need 5 bytes here
+//=========================================================================//
+//verify if the password set by user is correct
 
-  //generate the data array
-  dataArray[4] = uint8_t(captureTimeout / 140);  //this byte is sent first
-  dataArray[3] = ((startLocation-1) >> 8) & 0xFFU;  //high byte
-  dataArray[2] = uint8_t((startLocation-1) & 0xFFU);  //low byte
-  dataArray[1] = (count >> 8) & 0xFFU; //high byte
-  dataArray[0] = uint8_t(count & 0xFFU); //low byte
+uint8_t R30X_FPS::verifyPassword (uint32_t inputPassword) {
+  uint8_t inputPasswordBytes[4] = {0};  //to store the split password
+  inputPasswordBytes[0] = (inputPassword >> 24) & 0xFFU;  //save each bytes, high byte first
+  inputPasswordBytes[1] = (inputPassword >> 16) & 0xFFU;
+  inputPasswordBytes[2] = (inputPassword >> 8) & 0xFFU;
+  inputPasswordBytes[3] = inputPassword & 0xFFU;
 
-  #ifdef FPS_DEBUG
-    debugPort.println(F("Starting capture and range search."));
-    debugPort.print(F("captureTimeout = "));
-    debugPort.println(captureTimeout);
-    debugPort.print(F("startLocation = #"));
-    debugPort.println(startLocation);
-    debugPort.print(F("count = "));
-    debugPort.println(count);
-    debugPort.print(F("startLocation + count = "));
-    debugPort.println(startLocation + count);
-  #endif
+  sendCommand<FPS_CMD_VERIFYPASSWORD>(inputPasswordBytes); //send the command and data
 
-  sendPacket(FPS_ID_COMMANDPACKET, FPS_CMD_SCANANDRANGESEARCH, dataArray, 5); //send the command, there's no additional data
-  uint8_t response = receivePacket(captureTimeout + 100); //read response
+  uint8_t response = receivePacket(); //read response
+  bool cacheDiscarded = false;
+
+  if((response == FPS_RX_TIMEOUT) && sysParaCached) { //the module may have been reset to the default baudrate
+    discardSysPara();
+    cacheDiscarded = true;
+    sendCommand<FPS_CMD_VERIFYPASSWORD>(inputPasswordBytes);
+    response = receivePacket();
+  }
 
   if(response == FPS_RX_OK) { //if the response packet is valid
-    if(rxConfirmationCode == FPS_RESP_OK) { //the confirm code will be saved when the response is received
-      fingerId = (uint16_t(rxDataBuffer[3]) << 8) + rxDataBuffer[2];  //high byte + low byte
-      fingerId += 1;  //because IDs start from #1
-      matchScore = (uint16_t(rxDataBuffer[1]) << 8) + rxDataBuffer[0];  //data length will be 4 here
+    sysParaCached = false;  //the module answers at the cached baudrate
+
+    if(rxConfirmationCode == FPS_RESP_OK) {
+      //save the input password if it is correct
+      //this is actually redundant, but can make sure the right password is available to execute further commands
+      devicePasswordL = inputPassword;
+      devicePassword[0] = inputPasswordBytes[0]; //save the new password as array
+      devicePassword[1] = inputPasswordBytes[1];
+      devicePassword[2] = inputPasswordBytes[2];
+      devicePassword[3] = inputPasswordBytes[3];
+      sessionVerified = true;
 
       #ifdef FPS_DEBUG
-        debugPort.println(F("Capture and range search successful."));
-        debugPort.print(F("fingerId = #"));
-        debugPort.println(fingerId);
-        debugPort.print(F("matchScore = "));
-        debugPort.println(matchScore);
+        debugPort.println(F("Password is correct."));
+        debugPort.print(F("Current Password = "));
+        debugPort.println(devicePasswordL, HEX);
       #endif
 
-      return FPS_RESP_OK;
+      if(cacheDiscarded) {  //learn the real parameters, and have the cache saved again
+        readSysPara();
+        sysParaChanged = true;
+      }
+
+      return FPS_RESP_OK; //password is correct
     }
     else {
-      fingerId = 0;
-      matchScore = 0;
-
       #ifdef FPS_DEBUG
-        debugPort.println(F("Fingerprint not found."));
+        debugPort.println(F("Password is not correct."));
+        debugPort.print(F("Tested Password = "));
+        debugPort.println(inputPassword, HEX);
         debugPort.print(F("rxConfirmationCode = "));
         debugPort.println(rxConfirmationCode, HEX);
       #endif
 
-      return rxConfirmationCode;  //setting was unsuccessful and so send confirmation code
+      return rxConfirmationCode;  //password is not correct and so send confirmation code
     }
   }
   else {
@@ -1273,43 +1605,72 @@ uint8_t R30X_FPS::captureAndRangeSearch (uint16_t captureTimeout, uint16_t start
 }
 
 //=========================================================================//
-//scans the fingerprint and finds a match within the full range of library
-//a timeout can not be specified here
+//verify the saved password, but only if it's needed. the module forgets the
+//password when it is reset, which is noticed from the byte it sends after
+//a reset or when it rejects a command. call this instead of verifyPassword()
+//before the operations to save a round trip each time
+
+uint8_t R30X_FPS::verifySession (void) {
+  if(sessionVerified) {
+    return FPS_RESP_OK;
+  }
 
-uint8_t R30X_FPS::captureAndFullSearch () {
+  return verifyPassword(devicePasswordL);
+}
+
+//=========================================================================//
+//the module was reset or has lost the password. the character buffers are
+//also cleared by a reset
+
+void R30X_FPS::endSession (void) {
   #ifdef FPS_DEBUG
-    debugPort.println(F("Starting capture and full search."));
+    if(sessionVerified) {
+      debugPort.println(F("The module was reset. The password needs to be verified again."));
+    }
   #endif
 
-  sendPacket(FPS_ID_COMMANDPACKET, FPS_CMD_SCANANDFULLSEARCH); //send the command, there's no additional data
-  uint8_t response = receivePacket(3000); //read response
+  sessionVerified = false;
+  charBufferSlot[0] = 0;
+  charBufferSlot[1] = 0;
+}
+
+//=========================================================================//
+//set a new 4 byte password
+
+uint8_t R30X_FPS::setPassword (uint32_t inputPassword) {
+  uint8_t inputPasswordBytes[4] = {0};
+  inputPasswordBytes[0] = (inputPassword >> 24) & 0xFFU; //high byte first
+  inputPasswordBytes[1] = (inputPassword >> 16) & 0xFFU;
+  inputPasswordBytes[2] = (inputPassword >> 8) & 0xFFU;
+  inputPasswordBytes[3] = inputPassword & 0xFFU;
+
+  sendCommand<FPS_CMD_SETPASSWORD>(inputPasswordBytes); //send the command and data
+  uint8_t response = receivePacket(); //read response
 
   if(response == FPS_RX_OK) { //if the response packet is valid
-    if(rxConfirmationCode == FPS_RESP_OK) { //the confirm code will be saved when the response is received
-      fingerId = (uint16_t(rxDataBuffer[3]) << 8) + rxDataBuffer[2];  //high byte + low byte
-      fingerId += 1;  //because IDs start from #1
-      matchScore = (uint16_t(rxDataBuffer[1]) << 8) + rxDataBuffer[0];  //data length will be 4 here
+    if(rxConfirmationCode == FPS_RESP_OK) { //the confrim code will be saved when the response is received
+      devicePasswordL = inputPassword; //save the new password (Long)
+      devicePassword[0] = inputPasswordBytes[0]; //save the new password as array
+      devicePassword[1] = inputPasswordBytes[1];
+      devicePassword[2] = inputPasswordBytes[2];
+      devicePassword[3] = inputPasswordBytes[3];
 
       #ifdef FPS_DEBUG
-        debugPort.println(F("Capture and full search successful."));
-        debugPort.print(F("fingerId = #"));
-        debugPort.println(fingerId);
-        debugPort.print(F("matchScore = "));
-        debugPort.println(matchScore);
+        debugPort.println(F("Setting password successful."));
+        debugPort.print(F("New password = "));
+        debugPort.println(devicePasswordL, HEX);
       #endif
 
-      return FPS_RESP_OK;
+      return FPS_RESP_OK; //password setting complete
     }
     else {
-      fingerId = 0;
-      matchScore = 0;
-
       #ifdef FPS_DEBUG
-        debugPort.println(F("Fingerprint not found."));
+        debugPort.println(F("Setting password failed."));
+        debugPort.print(F("Input Password = "));
+        debugPort.println(inputPassword, HEX);
         debugPort.print(F("rxConfirmationCode = "));
         debugPort.println(rxConfirmationCode, HEX);
       #endif
-
       return rxConfirmationCode;  //setting was unsuccessful and so send confirmation code
     }
   }
@@ -1319,26 +1680,41 @@ uint8_t R30X_FPS::captureAndFullSearch () {
 }
 
 //=========================================================================//
-//scan the fingerprint, generate an image and store it in the image buffer
+//set a new 4 byte device address. if the operation is successful, the new
+//address will be saved
 
-uint8_t R30X_FPS::generateImage () {
-  #ifdef FPS_DEBUG
-    debugPort.println(F("Generating fingerprint image.."));
-  #endif
+uint8_t R30X_FPS::setAddress (uint32_t address) {
+  uint8_t addressArray[4] = {0}; //just so that we do not need to alter the existing address before successfully changing it
+  addressArray[0] = (address >> 24) & 0xFF;  //high byte first
+  addressArray[1] = (address >> 16) & 0xFF;
+  addressArray[2] = (address >> 8) & 0xFF;
+  addressArray[3] = address & 0xFF;
+
+  sendCommand<FPS_CMD_SETDEVICEADDRESS>(addressArray); //send the command and data
+
+  deviceAddressL = address; //save the new address (Long)
+  deviceAddress[0] = addressArray[3]; //save the new address as array, low byte first
+  deviceAddress[1] = addressArray[2];
+  deviceAddress[2] = addressArray[1];
+  deviceAddress[3] = addressArray[0];
 
-  sendPacket(FPS_ID_COMMANDPACKET, FPS_CMD_SCANFINGER); //send the command, there's no additional data
   uint8_t response = receivePacket(); //read response
 
   if(response == FPS_RX_OK) { //if the response packet is valid
-    if(rxConfirmationCode == FPS_RESP_OK) { //the confirm code will be saved when the response is received
+    if((rxConfirmationCode == FPS_RESP_OK) || (rxConfirmationCode == 0x20U)) { //the confrim code will be saved when the response is received
+      sysParaChanged = true;
+
       #ifdef FPS_DEBUG
-        debugPort.println(F("Image saved to buffer successfully."));
+        debugPort.println(F("Setting address successful."));
+        debugPort.print(F("New address = "));
+        debugPort.println(deviceAddressL, HEX);
       #endif
-      return FPS_RESP_OK; //just the confirmation code only
+
+      return FPS_RESP_OK; //address setting complete
     }
     else {
       #ifdef FPS_DEBUG
-        debugPort.println(F("Generating fingerprint failed."));
+        debugPort.println(F("Setting address failed."));
         debugPort.print(F("rxConfirmationCode = "));
         debugPort.println(rxConfirmationCode, HEX);
       #endif
@@ -1351,237 +1727,350 @@ uint8_t R30X_FPS::generateImage () {
 }
 
 //=========================================================================//
-//export the image stored in one of the buffers to the computer
-//this is not fully implemented. please do not use it
+//change the baudrate and reinitialize the port. the new baudrate will be
+//saved after successful execution
 
-uint8_t R30X_FPS::exportImage () {
-  sendPacket(FPS_ID_COMMANDPACKET, FPS_CMD_EXPORTIMAGE); //send the command, there's no additional data
-  uint8_t response = receivePacket(); //read response
+uint8_t R30X_FPS::setBaudrate (uint32_t baud) {
+  uint8_t baudNumber = baud / 9600; //check if the baudrate is a multiple of 9600
+  uint8_t dataArray[2] = {0};
 
-  if(response == FPS_RX_OK) { //if the response packet is valid
-    if(rxConfirmationCode == FPS_RESP_OK) { //the confirm code will be saved when the response is received
-      return FPS_RESP_OK; //just the confirmation code only
-    }
-    else {
-      return rxConfirmationCode;  //setting was unsuccessful and so send confirmation code
-    }
-  }
-  else {
-    return response; //return packet receive error code
-  }
-}
+  #ifdef FPS_DEBUG
+    debugPort.print(F("Input baudrate = "));
+    debugPort.println(baud);
+    debugPort.print(F("Baud number = "));
+    debugPort.println(baudNumber);
+  #endif
 
-//=========================================================================//
-//import an image file from computer to one of the buffers.
-//this is not fully implemented. please do not use it
+  if((baudNumber > 0) && (baudNumber < 13)) { //should be between 1 (9600bps) and 12 (115200bps)
+    dataArray[0] = 4; //the code for the system parameter number, 4 means baudrate
+    dataArray[1] = baudNumber;
 
-uint8_t R30X_FPS::importImage (uint8_t* dataBuffer) {
-  sendPacket(FPS_ID_COMMANDPACKET, FPS_CMD_IMPORTIMAGE, dataBuffer, 64); //send the command, there's no additional data
-  uint8_t response = receivePacket(); //read response
+    sendCommand<FPS_CMD_SETSYSPARA>(dataArray); //send the command and data
+    uint8_t response = receivePacket(); //read response
 
-  if(response == FPS_RX_OK) { //if the response packet is valid
-    if(rxConfirmationCode == FPS_RESP_OK) { //the confirm code will be saved when the response is received
-      return FPS_RESP_OK; //just the confirmation code only
-    }
-    else {
-      return rxConfirmationCode;  //setting was unsuccessful and so send confirmation code
-    }
+    if(response == FPS_RX_OK) { //if the response packet is valid
+      if(rxConfirmationCode == FPS_RESP_OK) { //the confirm code will be saved when the response is received
+        deviceBaudrate = baud;
+        sysParaChanged = true;
+
+        #ifdef FPS_ADAPTIVE_TIMEOUT
+          resetTimeouts();  //the response times include the time on the wire
+        #endif
+        
+        reinitializePort(deviceBaudrate);
+
+        #ifdef FPS_DEBUG
+          debugPort.println(F("Setting baudrate successful."));
+        #endif
+        return FPS_RESP_OK; //baudrate setting complete
+      }
+      else {
+        #ifdef FPS_DEBUG
+          debugPort.println(F("Setting baudrate failed."));
+          debugPort.print(F("rxConfirmationCode = "));
+          debugPort.println(rxConfirmationCode, HEX);
+        #endif
+        return rxConfirmationCode;  //setting was unsuccessful and so send confirmation code
+      }
+    }
+    else {
+      return response; //return packet receive error code
+    }
   }
   else {
-    return response; //return packet receive error code
+    #ifdef FPS_DEBUG
+      debugPort.println(F("Bad baudrate value."));
+      debugPort.println(F("Setting baudrate failed."));
+    #endif
+    return FPS_BAD_VALUE;
   }
 }
 
 //=========================================================================//
-//generate a character file from image stored in image buffer and store it in
-//one of the two character buffers
+//reinitializes the serial port with a new baud rate, without changing the
+//device configuration. this is useful when you don't already know the
+//device's configured baud rate
 
-uint8_t R30X_FPS::generateCharacter (uint8_t bufferId) {
-  if(!((bufferId > 0) && (bufferId < 3))) { //if the value is not 1 or 2
-    #ifdef FPS_DEBUG
-      debugPort.println(F("Generating character file failed."));
-      debugPort.println(F("Bad value. bufferId can only be 1 or 2."));
-      debugPort.print(F("bufferId = "));
-      debugPort.println(bufferId);
-    #endif
+uint8_t R30X_FPS::reinitializePort(uint32_t baud) {
+  if(hwSerial) { //if using hardware serial
+    hwSerial->end();  //end the existing serial port
+    hwSerial->begin(baud);  //restart the port with new baudrate
 
-    return FPS_BAD_VALUE;
+    #ifdef FPS_RX_EVENTS
+      attachReceiveEvent(); //the callback has to be registered again
+    #endif
   }
-  uint8_t dataBuffer[1] = {bufferId}; //create data array
 
-  #ifdef FPS_DEBUG
-    debugPort.println(F("Generating character file.."));
-    debugPort.print(F("Character bufferId = "));
-    debugPort.println(bufferId);
+  #if defined(__AVR__) || defined(ESP8266)
+    if (swSerial) { //if using software serial
+      swSerial->end();  //stop existing serial port
+      swSerial->begin(baud);  //restart the port with new baudrate
+    }
   #endif
-  
-  sendPacket(FPS_ID_COMMANDPACKET, FPS_CMD_IMAGETOCHARACTER, dataBuffer, 1);
-  uint8_t response = receivePacket(); //read response
 
-  if(response == FPS_RX_OK) { //if the response packet is valid
-    if(rxConfirmationCode == FPS_RESP_OK) { //the confirm code will be saved when the response is received
-      #ifdef FPS_DEBUG
-        debugPort.println(F("Generating character file successful."));
-      #endif
-      return FPS_RESP_OK; //just the confirmation code only
-    }
-    else {
-      #ifdef FPS_DEBUG
-        debugPort.println(F("Generating character file failed."));
-        debugPort.print(F("rxConfirmationCode = "));
-        debugPort.println(rxConfirmationCode, HEX);
+  #ifdef FPS_DEBUG
+    debugPort.println(F("Reinitialized port."));
+  #endif
+}
 
-        if(rxConfirmationCode == FPS_RESP_OVERDISORDERFAIL2) {
-          debugPort.println(F("Character file overly disordered."));
-        }
+//=========================================================================//
+//change the security level - or the threshold for matching two fingerprint
+//templates
 
-        if(rxConfirmationCode == FPS_RESP_FEATUREFAIL) {
-          debugPort.println(F("Character file feature fail."));
-        }
+uint8_t R30X_FPS::setSecurityLevel (uint8_t level) {
+  uint8_t dataArray[2] = {0};
 
-        if(rxConfirmationCode == FPS_RESP_IMAGEGENERATEFAIL) {
-          debugPort.println(F("Valid image not available."));
-        }
+  if((level > 0) && (level < 6)) { //should be between 1 and 5
+    dataArray[0] = 5; //the code for the system parameter number, 5 means the security level
+    dataArray[1] = level;
 
-      #endif
+    sendCommand<FPS_CMD_SETSYSPARA>(dataArray); //send the command and data
+    uint8_t response = receivePacket(); //read response
 
-      return rxConfirmationCode;  //setting was unsuccessful and so send confirmation code
+    if(response == FPS_RX_OK) { //if the response packet is valid
+      if(rxConfirmationCode == FPS_RESP_OK) { //the confirm code will be saved when the response is received
+        #ifdef FPS_DEBUG
+          debugPort.println(F("Setting new security level successful."));
+          debugPort.print(F("Old value = "));
+          debugPort.println(securityLevel, HEX);
+          debugPort.print(F("New value = "));
+          debugPort.println(level, HEX);
+        #endif
+        securityLevel = level;  //save new value
+        sysParaChanged = true;
+        return FPS_RESP_OK; //security level setting complete
+      }
+      else {
+        #ifdef FPS_DEBUG
+          debugPort.println(F("Setting security level failed."));
+          debugPort.print(F("Current value = "));
+          debugPort.println(securityLevel, HEX);
+          debugPort.print(F("rxConfirmationCode = "));
+          debugPort.println(rxConfirmationCode, HEX);
+        #endif
+        return rxConfirmationCode;  //setting was unsuccessful and so send confirmation code
+      }
+    }
+    else {
+      return response; //return packet receive error code
     }
   }
   else {
-    return response; //return packet receive error code
+    #ifdef FPS_DEBUG
+      debugPort.println(F("Bad security level value."));
+      debugPort.println(F("Setting security level failed."));
+    #endif
+    return FPS_BAD_VALUE; //the received parameter is invalid
   }
 }
 
 //=========================================================================//
-//combine the two character files from buffers and generate a template
-//the template will be saved to the both the buffers
+//set the max length of data bytes that can be received from the module
 
-uint8_t R30X_FPS::generateTemplate () {
-  #ifdef FPS_DEBUG
-    debugPort.println(F("Generating template from char buffers.."));
+uint8_t R30X_FPS::setDataLength (uint16_t length) {
+   #ifdef FPS_DEBUG
+    debugPort.println(F("Setting new data length.."));
   #endif
 
-  sendPacket(FPS_ID_COMMANDPACKET, FPS_CMD_GENERATETEMPLATE); //send the command, there's no additional data
-  uint8_t response = receivePacket(); //read response
+  uint8_t dataArray[2] = {0};
 
-  if(response == FPS_RX_OK) { //if the response packet is valid
-    if(rxConfirmationCode == FPS_RESP_OK) { //the confirm code will be saved when the response is received
-      #ifdef FPS_DEBUG
-        debugPort.println(F("Generating template successful."));
-      #endif
-      return FPS_RESP_OK; //just the confirmation code only
-    }
-    else {
-      #ifdef FPS_DEBUG
-        debugPort.println(F("Generating template failed."));
-        debugPort.print(F("rxConfirmationCode = "));
-        debugPort.println(rxConfirmationCode, HEX);
-      #endif
-      return rxConfirmationCode;  //setting was unsuccessful and so send confirmation code
-    }
-  }
-  else {
-    return response; //return packet receive error code
+  if(length > FPS_MAX_DATA_LENGTH) { //the frame buffers can't hold it
+    #ifdef FPS_DEBUG
+      debugPort.print(F("Data length can't be more than "));
+      debugPort.println(FPS_MAX_DATA_LENGTH);
+    #endif
+    return FPS_BAD_VALUE;
   }
-}
 
-//=========================================================================//
-//export a character file from one of the buffers to the computer
-//this is not completely implemented. please do not use it
+  if((length == 32) || (length == 64) || (length == 128) || (length == 256)) { //should be 32, 64, 128 or 256 bytes
+    dataArray[0] = 6; //the code for the system parameter number
 
-uint8_t R30X_FPS::exportCharacter (uint8_t bufferId) {
-  uint8_t dataBuffer[1] = {bufferId}; //create data array
-  sendPacket(FPS_ID_COMMANDPACKET, FPS_CMD_IMPORTIMAGE);
-  uint8_t response = receivePacket(); //read response
+    if(length == 32)
+      dataArray[1] = 0;
+    else if(length == 64)
+      dataArray[1] = 1;
+    else if(length == 128)
+      dataArray[1] = 2;
+    else if(length == 256)
+      dataArray[1] = 3;
+    sendCommand<FPS_CMD_SETSYSPARA>(dataArray); //send the command and data
+    uint8_t response = receivePacket(); //read response
 
-  if(response == FPS_RX_OK) { //if the response packet is valid
-    if(rxConfirmationCode == FPS_RESP_OK) { //the confirm code will be saved when the response is received
-      return FPS_RESP_OK; //just the confirmation code only
+    if(response == FPS_RX_OK) { //if the response packet is valid
+      if(rxConfirmationCode == FPS_RESP_OK) { //the confirm code will be saved when the response is received
+        dataPacketLength = length;  //save the new data length
+        sysParaChanged = true;
+
+        #ifdef FPS_DEBUG
+          debugPort.println(F("Setting data length successful."));
+          debugPort.print(F("dataPacketLength = "));
+          debugPort.println(dataPacketLength);
+        #endif
+
+        return FPS_RESP_OK; //length setting complete
+      }
+      else {
+        #ifdef FPS_DEBUG
+          debugPort.println(F("Setting data length failed."));
+          debugPort.print(F("rxConfirmationCode = "));
+          debugPort.println(rxConfirmationCode, HEX);
+        #endif
+        return rxConfirmationCode;  //setting was unsuccessful and so send confirmation code
+      }
     }
     else {
-      return rxConfirmationCode;  //setting was unsuccessful and so send confirmation code
+      return response; //return packet receive error code
     }
   }
   else {
-    return response; //return packet receive error code
+    #ifdef FPS_DEBUG
+      debugPort.println(F("Bad data length value."));
+      debugPort.println(F("Setting data length failed."));
+    #endif
+    return FPS_BAD_VALUE; //the received parameter is invalid
   }
 }
 
 //=========================================================================//
-//import a character file from computer to one of the buffers
-//this is not completely implemented. please do not use it
+//turns the communication port on/off
 
-uint8_t R30X_FPS::importCharacter (uint8_t bufferId, uint8_t* dataBuffer) {
-  uint8_t dataArray[sizeof(dataBuffer)+1] = {0}; //create data array
-  dataArray[sizeof(dataBuffer)];
-  sendPacket(FPS_ID_COMMANDPACKET, FPS_CMD_IMPORTIMAGE);
-  uint8_t response = receivePacket(); //read response
+uint8_t R30X_FPS::portControl (uint8_t value) {
+  #ifdef FPS_DEBUG
+    if(value == 1)
+      debugPort.println(F("Turning on port.."));
+    else
+      debugPort.println(F("Turning off port.."));
+  #endif
 
-  if(response == FPS_RX_OK) { //if the response packet is valid
-    if(rxConfirmationCode == FPS_RESP_OK) { //the confirm code will be saved when the response is received
-      return FPS_RESP_OK; //just the confirmation code only
+  uint8_t dataArray[1] = {0};
+
+  if((value == 0) || (value == 1)) { //should be either 1 or 0
+    dataArray[0] = value;
+    sendCommand<FPS_CMD_PORTCONTROL>(dataArray); //send the command and data
+    uint8_t response = receivePacket(); //read response
+
+    if(response == FPS_RX_OK) { //if the response packet is valid
+      if(rxConfirmationCode == FPS_RESP_OK) { //the confirm code will be saved when the response is received
+        #ifdef FPS_DEBUG
+          if(value == 1)
+            debugPort.println(F("Turning on port successful."));
+          else
+            debugPort.println(F("Turning off port successful."));
+        #endif
+        return FPS_RESP_OK; //port setting complete
+      }
+      else {
+        #ifdef FPS_DEBUG
+          debugPort.println(F("Turning on/off port failed."));
+          debugPort.print(F("rxConfirmationCode = "));
+          debugPort.println(rxConfirmationCode, HEX);
+        #endif
+        return rxConfirmationCode;  //setting was unsuccessful and so send confirmation code
+      }
     }
     else {
-      return rxConfirmationCode;  //setting was unsuccessful and so send confirmation code
+      return response; //return packet receive error code
     }
   }
   else {
-    return response; //return packet receive error code
+    return FPS_BAD_VALUE; //the received parameter is invalid
   }
 }
 
 //=========================================================================//
-//store the contents of one of the two template (character) buffers to a
-//location on the fingerprint library
+//read system configuration
 
-uint8_t R30X_FPS::saveTemplate (uint8_t bufferId, uint16_t location) {
-  if(!((bufferId > 0) && (bufferId < 3))) { //if the value is not 1 or 2
-    #ifdef FPS_DEBUG
-      debugPort.println(F("Storing template failed."));
-      debugPort.println(F("Bad value. bufferId can only be 1 or 2."));
-      debugPort.print(F("bufferId = "));
-      debugPort.println(bufferId);
-    #endif
+uint8_t R30X_FPS::readSysPara() {
+  uint8_t response = beginReadSysPara();
 
-    return FPS_BAD_VALUE;
+  if(response != FPS_RX_OK) {
+    return response;
   }
 
-  if((location > 1000) || (location < 1)) { //if the value is not in range
-    #ifdef FPS_DEBUG
-      debugPort.println(F("Generating template failed."));
-      debugPort.println(F("Bad value. location must be #1 to #1000."));
-      debugPort.print(F("location = "));
-      debugPort.println(location);
-    #endif
+  return finishReadSysPara(receivePacket()); //read response
+}
 
-    return FPS_BAD_VALUE;
-  }
+//=========================================================================//
+//start reading the system configuration without waiting for the response.
+//poll it with pollPacket() and pass the result to finishReadSysPara()
 
+uint8_t R30X_FPS::beginReadSysPara (void) {
   #ifdef FPS_DEBUG
-    debugPort.println(F("Saving template.."));
+    debugPort.println(F("Reading system parameters.."));
   #endif
 
-  uint8_t dataArray[3] = {0}; //create data array
-  dataArray[2] = bufferId;  //highest byte
-  dataArray[1] = ((location-1) >> 8) & 0xFFU; //high byte of location
-  dataArray[0] = ((location-1) & 0xFFU); //low byte of location
+  uint8_t response = sendCommand<FPS_CMD_READSYSPARA>(); //send the command, there's no additional data
 
-  sendPacket(FPS_ID_COMMANDPACKET, FPS_CMD_STORETEMPLATE, dataArray, 3); //send the command and data
-  uint8_t response = receivePacket(); //read response
+  if(response != FPS_RX_OK) {
+    return response;
+  }
+
+  beginReceive();
+  return FPS_RX_OK;
+}
+
+//=========================================================================//
+//extract the system configuration from the response of beginReadSysPara()
 
+uint8_t R30X_FPS::finishReadSysPara (uint8_t response) {
   if(response == FPS_RX_OK) { //if the response packet is valid
     if(rxConfirmationCode == FPS_RESP_OK) { //the confirm code will be saved when the response is received
+      FPS_PacketView packet = getPacketView(); //the fields are read straight from the frame
+
+      if((systemID != packet.getWord(2)) || (librarySize != packet.getWord(4)) || (securityLevel != packet.getWord(6)) ||
+        (deviceAddressL != packet.getLong(8)) || (dataPacketLength != (32U << (packet.getWord(12) & 3))) ||
+        (deviceBaudrate != (packet.getWord(14) * 9600UL))) {
+        sysParaChanged = true;  //a saved cache is out of date
+      }
+
+      statusRegister = packet.getWord(0);
+      systemID = packet.getWord(2);
+      librarySize = packet.getWord(4);
+      securityLevel = packet.getWord(6);
+      deviceAddressL = packet.getLong(8);
+      dataPacketLengthCode = packet.getWord(12);
+      baudMultiplier = packet.getWord(14);
+
+      if(dataPacketLengthCode == 0)
+        dataPacketLength = 32;
+      else if(dataPacketLengthCode == 1)
+        dataPacketLength = 64;
+      else if(dataPacketLengthCode == 2)
+        dataPacketLength = 128;
+      else if(dataPacketLengthCode == 3)
+        dataPacketLength = 256;
+
+      deviceBaudrate = uint32_t(baudMultiplier * 9600);  //baudrate is retrieved as a multiplier
+
       #ifdef FPS_DEBUG
-        debugPort.println(F("Storing template successful."));
-        debugPort.print(F("Saved to #"));
-        debugPort.println(location);
+        if(dataPacketLength > FPS_MAX_DATA_LENGTH) {
+          debugPort.println(F("The data packets of the module are too long for this board. Set a shorter data length."));
+        }
+        debugPort.println(F("Reading system parameters successful."));
+        debugPort.print(F("statusRegister = 0x"));
+        debugPort.println(statusRegister, HEX);
+        debugPort.print(F("systemID = 0x"));
+        debugPort.println(systemID, HEX);
+        debugPort.print(F("librarySize = "));
+        debugPort.println(librarySize);
+        debugPort.print(F("securityLevel = 0x"));
+        debugPort.println(securityLevel, HEX);
+        debugPort.print(F("deviceAddressL = 0x"));
+        debugPort.println(deviceAddressL, HEX);
+        debugPort.print(F("dataPacketLengthCode = 0x"));
+        debugPort.println(dataPacketLengthCode, HEX);
+        debugPort.print(F("baudMultiplier = 0x"));
+        debugPort.println(baudMultiplier, HEX);
+        debugPort.print(F("deviceBaudrate = "));
+        debugPort.print(deviceBaudrate);
+        debugPort.println(F(" bps"));
       #endif
-      return FPS_RESP_OK; //just the confirmation code only
+
+      return FPS_RESP_OK;
     }
     else {
       #ifdef FPS_DEBUG
-        debugPort.println(F("Storing template failed."));
+        debugPort.println(F("Reading system parameters failed."));
         debugPort.print(F("rxConfirmationCode = "));
         debugPort.println(rxConfirmationCode, HEX);
       #endif
@@ -1594,155 +2083,155 @@ uint8_t R30X_FPS::saveTemplate (uint8_t bufferId, uint16_t location) {
 }
 
 //=========================================================================//
-//load the contents from a location on the library to one of the two
-//template/character buffers
+//save the system parameters known to the library, so that they can be loaded
+//with importSysPara() at the next start instead of reading them from the
+//module. keep the bytes in EEPROM or a file. the cache must have room for
+//FPS_SYSPARA_CACHE_LENGTH bytes
 
-uint8_t R30X_FPS::loadTemplate (uint8_t bufferId, uint16_t location) {
-  if(!((bufferId > 0) && (bufferId < 3))) { //if the value is not 1 or 2
-    #ifdef FPS_DEBUG
-      debugPort.println(F("Loading template failed."));
-      debugPort.println(F("Bad value. bufferId can only be 1 or 2."));
-      debugPort.print(F("bufferId = "));
-      debugPort.println(bufferId);
-    #endif
+void R30X_FPS::exportSysPara (uint8_t* cache) {
+  uint16_t lengthCode = 0;
 
-    return FPS_BAD_VALUE;
+  while((lengthCode < 3) && ((32U << lengthCode) < dataPacketLength)) {
+    lengthCode++;
   }
 
-  if((location > 1000) || (location < 1)) { //if the value is not in range
+  uint32_t values[7] = {FPS_SYSPARA_CACHE_MAGIC, systemID, deviceAddressL, librarySize, securityLevel, lengthCode, (deviceBaudrate / 9600)};
+  uint8_t widths[7] = {4, 2, 4, 2, 2, 2, 2};  //bytes of each value
+  uint8_t position = 0;
+
+  for(uint8_t i=0; i < 7; i++) {
+    for(uint8_t j=widths[i]; j > 0; j--) { //high byte first
+      cache[position++] = (values[i] >> ((j - 1) * 8)) & 0xFFU;
+    }
+  }
+
+  uint16_t checksum = copyWithChecksum(NULL, cache, position);
+  cache[position++] = (checksum >> 8) & 0xFFU;
+  cache[position] = checksum & 0xFFU;
+
+  sysParaChanged = false;
+}
+
+//=========================================================================//
+//use the system parameters saved with exportSysPara(). the cache is only
+//used if it is intact and was saved for the same address. call this before
+//begin() and start the port with deviceBaudrate. readSysPara() can still
+//be called later, and sets sysParaChanged if the module doesn't agree. if the
+//module doesn't answer the first verifyPassword() at the cached baudrate,
+//the cache is dropped and the password is sent again at the default one
+
+uint8_t R30X_FPS::importSysPara (const uint8_t* cache) {
+  FPS_PacketView view(cache, FPS_SYSPARA_CACHE_LENGTH);
+  uint16_t lengthCode = view.getWord(14);
+  uint16_t multiplier = view.getWord(16);
+
+  if((view.getLong(0) != FPS_SYSPARA_CACHE_MAGIC) ||
+    (view.getWord(18) != copyWithChecksum(NULL, cache, FPS_SYSPARA_CACHE_LENGTH - 2)) ||
+    (view.getLong(6) != deviceAddressL) || (lengthCode > 3) || (multiplier < 1) || (multiplier > 12)) {
     #ifdef FPS_DEBUG
-      debugPort.println(F("Loading template failed."));
-      debugPort.println(F("Bad value. location must be #1 to #1000."));
-      debugPort.print(F("location = "));
-      debugPort.println(location);
+      debugPort.println(F("System parameter cache is not valid for this module."));
     #endif
-
     return FPS_BAD_VALUE;
   }
 
-  uint8_t dataArray[3] = {0}; //create data array
-  dataArray[2] = bufferId;  //highest byte
-  dataArray[1] = ((location-1) >> 8) & 0xFFU; //high byte of location
-  dataArray[0] = ((location-1) & 0xFFU); //low byte of location
+  systemID = view.getWord(4);
+  librarySize = view.getWord(10);
+  securityLevel = view.getWord(12);
+  dataPacketLengthCode = lengthCode;
+  dataPacketLength = 32U << lengthCode;
+  baudMultiplier = multiplier;
+  deviceBaudrate = uint32_t(multiplier) * 9600;
+  sysParaChanged = false;
+  sysParaCached = true;
 
   #ifdef FPS_DEBUG
-    debugPort.println(F("Loading template.."));
+    debugPort.println(F("System parameters loaded from the cache."));
+    debugPort.print(F("librarySize = "));
+    debugPort.println(librarySize);
+    debugPort.print(F("dataPacketLength = "));
+    debugPort.println(dataPacketLength);
+    debugPort.print(F("deviceBaudrate = "));
+    debugPort.print(deviceBaudrate);
+    debugPort.println(F(" bps"));
   #endif
 
-  sendPacket(FPS_ID_COMMANDPACKET, FPS_CMD_LOADTEMPLATE, dataArray, 3); //send the command and data
-  uint8_t response = receivePacket(); //read response
+  return FPS_RESP_OK;
+}
 
-  if(response == FPS_RX_OK) { //if the response packet is valid
-    if(rxConfirmationCode == FPS_RESP_OK) { //the confirm code will be saved when the response is received
-      #ifdef FPS_DEBUG
-        debugPort.println(F("Loading template successful."));
-        debugPort.print(F("Loaded #"));
-        debugPort.print(location);
-        debugPort.print(F(" to buffer "));
-        debugPort.println(bufferId);
-      #endif
+//=========================================================================//
+//the module didn't answer at the parameters loaded by importSysPara(). it may
+//have been reset or replaced, so go back to the defaults and the default
+//baudrate, which is what a module starts with
 
-      return FPS_RESP_OK; //just the confirmation code only
-    }
-    else {
-      #ifdef FPS_DEBUG
-        debugPort.println(F("Loading template failed."));
-        debugPort.print(F("rxConfirmationCode = "));
-        debugPort.println(rxConfirmationCode, HEX);
-      #endif
-      return rxConfirmationCode;  //setting was unsuccessful and so send confirmation code
-    }
-  }
-  else {
-    return response; //return packet receive error code
+void R30X_FPS::discardSysPara (void) {
+  #ifdef FPS_DEBUG
+    debugPort.println(F("No response at the cached baudrate. Trying the default baudrate."));
+  #endif
+
+  systemID = 0;
+  librarySize = 1000;
+  securityLevel = FPS_DEFAULT_SECURITY_LEVEL;
+  dataPacketLength = FPS_DEFAULT_RX_DATA_LENGTH;
+  dataPacketLengthCode = 1;
+  baudMultiplier = uint16_t(FPS_DEFAULT_BAUDRATE / 9600);
+  sysParaCached = false;
+
+  if(deviceBaudrate != FPS_DEFAULT_BAUDRATE) {
+    deviceBaudrate = FPS_DEFAULT_BAUDRATE;
+    reinitializePort(FPS_DEFAULT_BAUDRATE);
   }
 }
 
 //=========================================================================//
-//delete a set of templates saved in the flash memory
+//returns the total template count in the flash memory
 
-uint8_t R30X_FPS::deleteTemplate (uint16_t startLocation, uint16_t count) {
-  if((startLocation > 1000) || (startLocation < 1)) { //if the value is not 1 or 2
-    #ifdef FPS_DEBUG
-      debugPort.println(F("Deleting template failed."));
-      debugPort.println(F("Bad value. Start location must be #1 to #1000."));
-      debugPort.print(F("startLocation = "));
-      debugPort.println(startLocation);
-    #endif
+uint8_t R30X_FPS::getTemplateCount() {
+  uint8_t response = beginTemplateCount();
 
-    return FPS_BAD_VALUE;
+  if(response != FPS_RX_OK) {
+    return response;
   }
 
-  if((count + startLocation) > 1001) { //if the value is not in range
-    #ifdef FPS_DEBUG
-      debugPort.println(F("Deleting template failed."));
-      debugPort.println(F("Bad value. Sum of startLocation and count can't be greater than 1001."));
-      debugPort.print(F("startLocation + count = "));
-      debugPort.println(startLocation + count);
-    #endif
-
-    return FPS_BAD_VALUE;
-  }
+  return finishTemplateCount(receivePacket()); //read response
+}
 
-  uint8_t dataArray[4] = {0}; //create data array
-  dataArray[3] = ((startLocation-1) >> 8) & 0xFFU; //high byte of location
-  dataArray[2] = ((startLocation-1) & 0xFFU); //low byte of location
-  dataArray[1] = (count >> 8) & 0xFFU; //high byte of total no. of templates to delete
-  dataArray[0] = (count & 0xFFU); //low byte of count
+//=========================================================================//
+//start reading the template count without waiting for the response
 
+uint8_t R30X_FPS::beginTemplateCount (void) {
   #ifdef FPS_DEBUG
-    debugPort.println(F("Deleting template.."));
+    debugPort.println(F("Reading template count.."));
   #endif
 
-  sendPacket(FPS_ID_COMMANDPACKET, FPS_CMD_DELETETEMPLATE, dataArray, 4); //send the command and data
-  uint8_t response = receivePacket(); //read response
+  uint8_t response = sendCommand<FPS_CMD_TEMPLATECOUNT>(); //send the command, there's no additional data
 
-  if(response == FPS_RX_OK) { //if the response packet is valid
-    if(rxConfirmationCode == FPS_RESP_OK) { //the confirm code will be saved when the response is received
-     #ifdef FPS_DEBUG
-        debugPort.println(F("Deleting template successful."));
-        debugPort.print(F("From #"));
-        debugPort.print(startLocation);
-        debugPort.print(F(" to #"));
-        debugPort.println(startLocation + count - 1);
-      #endif
-      return FPS_RESP_OK; //just the confirmation code only
-    }
-    else {
-      #ifdef FPS_DEBUG
-        debugPort.println(F("Deleting template failed."));
-        debugPort.print(F("rxConfirmationCode = "));
-        debugPort.println(rxConfirmationCode, HEX);
-      #endif
-      return rxConfirmationCode;  //setting was unsuccessful and so send confirmation code
-    }
-  }
-  else {
-    return response; //return packet receive error code
+  if(response != FPS_RX_OK) {
+    return response;
   }
+
+  beginReceive();
+  return FPS_RX_OK;
 }
 
 //=========================================================================//
-//deletes all the templates stored in the library
-
-uint8_t R30X_FPS::clearLibrary () {
-  #ifdef FPS_DEBUG
-    debugPort.println(F("Clearing library.."));
-  #endif
-
-  sendPacket(FPS_ID_COMMANDPACKET, FPS_CMD_CLEARLIBRARY); //send the command
-  uint8_t response = receivePacket(); //read response
+//save the template count from the response of beginTemplateCount()
 
+uint8_t R30X_FPS::finishTemplateCount (uint8_t response) {
   if(response == FPS_RX_OK) { //if the response packet is valid
     if(rxConfirmationCode == FPS_RESP_OK) { //the confirm code will be saved when the response is received
+      templateCount = getPacketView().getWord(0);
+
       #ifdef FPS_DEBUG
-        debugPort.println(F("Clearing library successful."));
+        debugPort.println(F("Reading template count successful."));
+        debugPort.print(F("templateCount = "));
+        debugPort.println(templateCount);
       #endif
-      return FPS_RESP_OK; //just the confirmation code only
+
+      return FPS_RESP_OK;
     }
     else {
       #ifdef FPS_DEBUG
-        debugPort.println(F("Clearing library failed."));
+        debugPort.println(F("Reading template count failed."));
         debugPort.print(F("rxConfirmationCode = "));
         debugPort.println(rxConfirmationCode, HEX);
       #endif
@@ -1755,28 +2244,38 @@ uint8_t R30X_FPS::clearLibrary () {
 }
 
 //=========================================================================//
-//match the templates stored in the buffers and calculate a match score
+//read the index table of a page of the library. each of the 32 bytes covers
+//8 locations, the lowest bit being the lowest location. a set bit means the
+//location holds a template. page 0 covers the locations #1-#256
+
+uint8_t R30X_FPS::readIndexTable (uint8_t page, uint8_t* indexTable) {
+  if((page > 3) || (indexTable == NULL)) {
+    return FPS_BAD_VALUE;
+  }
+
+  uint8_t dataArray[1] = {page}; //create data array
 
-uint8_t R30X_FPS::matchTemplates () {
   #ifdef FPS_DEBUG
-    debugPort.println(F("Matching templates.."));
+    debugPort.print(F("Reading index table page "));
+    debugPort.println(page);
   #endif
 
-  sendPacket(FPS_ID_COMMANDPACKET, FPS_CMD_MATCHTEMPLATES); //send the command
+  sendCommand<FPS_CMD_READINDEXTABLE>(dataArray);
   uint8_t response = receivePacket(); //read response
 
   if(response == FPS_RX_OK) { //if the response packet is valid
     if(rxConfirmationCode == FPS_RESP_OK) { //the confirm code will be saved when the response is received
-      #ifdef FPS_DEBUG
-        debugPort.println(F("Matching templates successful."));
-      #endif
+      FPS_PacketView packet = getPacketView();
 
-      matchScore = uint16_t(rxDataBuffer[1] << 8) + rxDataBuffer[0];
-      return FPS_RESP_OK; //just the confirmation code only
+      for(uint8_t i=0; i < FPS_INDEX_TABLE_LENGTH; i++) {
+        indexTable[i] = packet.getByte(i);
+      }
+
+      return FPS_RESP_OK;
     }
     else {
       #ifdef FPS_DEBUG
-        debugPort.println(F("The templates do no match."));
+        debugPort.println(F("Reading index table failed."));
         debugPort.print(F("rxConfirmationCode = "));
         debugPort.println(rxConfirmationCode, HEX);
       #endif
@@ -1789,85 +2288,449 @@ uint8_t R30X_FPS::matchTemplates () {
 }
 
 //=========================================================================//
-//searches the contents of one of the two char buffers for a match on the
-//fingerprint library throughout a range
-
-uint8_t R30X_FPS::searchLibrary (uint8_t bufferId, uint16_t startLocation, uint16_t count) {
-  if(!((bufferId > 0) && (bufferId < 3))) { //if the value is not 1 or 2
-    #ifdef FPS_DEBUG
-      debugPort.println(F("Searching library failed."));
-      debugPort.println(F("Bad value. bufferId can only be 1 or 2."));
-      debugPort.print(F("bufferId = "));
-      debugPort.println(bufferId);
-    #endif
+//copy the templates in the library to a backup image. the image has a short
+//header followed by one record per template: the location and length, the
+//character file, and a checksum. only the occupied locations are copied. an
+//end record with location 0, the template count and the sum of the record
+//checksums closes the image, so that a cut off image can be told apart.
+//start with a cleared state and call until state->finished is true. the state
+//is updated after every record, so if a call fails, seek the output back to
+//state->length and call again to resume. maxTemplates limits the no. of
+//templates per call (0 for no limit), so that the state can be saved between
+//the calls. the index table page in use is kept in the state, so that small
+//slices don't read it again every time
+
+uint8_t R30X_FPS::backupLibrary (Print& output, FPS_BackupState* state, uint16_t maxTemplates) {
+  if(state == NULL) {
     return FPS_BAD_VALUE;
   }
 
-  if((startLocation > 1000) || (startLocation < 1)) { //if not in range (0-999)
-    #ifdef FPS_DEBUG
-      debugPort.println(F("Searching library failed."));
-      debugPort.println(F("Bad start ID"));
-      debugPort.print(F("startId = #"));
-      debugPort.println(startLocation);
-    #endif
-    return FPS_BAD_VALUE;
+  if(state->finished) {
+    return FPS_RESP_OK;
   }
 
-  if((startLocation + count) > 1001) { //if range overflows
-    #ifdef FPS_DEBUG
-      debugPort.println(F("Searching library failed."));
-      debugPort.println(F("startLocation + count can't be greater than 1001."));
-      debugPort.print(F("startLocation = #"));
-      debugPort.println(startLocation);
-      debugPort.print(F("count = "));
-      debugPort.println(count);
-      debugPort.print(F("startLocation + count = "));
-      debugPort.println(startLocation + count);
-    #endif
-    return FPS_BAD_VALUE;
+  uint8_t response;
+
+  if(state->location == 0) { //new backup
+    response = readSysPara();  //for the library size
+
+    if(response != FPS_RESP_OK) {
+      return response;
+    }
+
+    uint8_t header[FPS_BACKUP_HEADER_LENGTH] = {
+      uint8_t(FPS_BACKUP_MAGIC >> 24), uint8_t(FPS_BACKUP_MAGIC >> 16), uint8_t(FPS_BACKUP_MAGIC >> 8), uint8_t(FPS_BACKUP_MAGIC),
+      FPS_BACKUP_VERSION, 0, uint8_t(librarySize >> 8), uint8_t(librarySize & 0xFFU)
+    };
+
+    if(output.write(header, FPS_BACKUP_HEADER_LENGTH) != FPS_BACKUP_HEADER_LENGTH) {
+      return FPS_OUTPUT_FAIL;
+    }
+
+    state->location = 1;
+    state->librarySize = librarySize;
+    state->templateCount = 0;
+    state->checksum = 0;
+    state->length = FPS_BACKUP_HEADER_LENGTH;
+    state->indexPage = 0;
   }
 
-  uint8_t dataArray[5] = {0};
-  dataArray[4] = bufferId;
-  dataArray[3] = (startLocation >> 8) & 0xFFU;  //high byte
-  dataArray[2] = (startLocation & 0xFFU); //low byte
-  dataArray[1] = (count >> 8) & 0xFFU; //high byte
-  dataArray[0] = (count & 0xFFU); //low byte
+  int16_t indexPage = int16_t(state->indexPage) - 1; //the page read by an earlier call is still in the state
+  uint16_t copiedCount = 0;
 
-  #ifdef FPS_DEBUG
-    debugPort.println(F("Starting searching library for buffer content."));
-    debugPort.print(F("bufferId = "));
-    debugPort.println(bufferId);
-    debugPort.print(F("startLocation = #"));
-    debugPort.println(startLocation);
-    debugPort.print(F("count = "));
-    debugPort.println(count);
-    debugPort.print(F("startLocation + count = "));
-    debugPort.println(startLocation + count);
-  #endif
+  while(true) {
+    if((maxTemplates != 0) && (copiedCount >= maxTemplates)) {
+      return FPS_RESP_OK;
+    }
 
-  sendPacket(FPS_ID_COMMANDPACKET, FPS_CMD_SEARCHLIBRARY, dataArray, 5); //send the command
-  uint8_t response = receivePacket(); //read response
+    response = findTemplate(&state->location, state->librarySize, state->indexTable, &indexPage);
+    state->indexPage = uint8_t(indexPage + 1);
+
+    if(response != FPS_RESP_OK) {
+      return response;
+    }
+
+    if(state->location > state->librarySize) { //no more templates
+      break;
+    }
+
+    response = loadTemplate(1, state->location);
+
+    if(response != FPS_RESP_OK) {
+      return response;
+    }
+
+    uint8_t recordHeader[4] = {
+      uint8_t(state->location >> 8), uint8_t(state->location & 0xFFU),
+      uint8_t(FPS_CHARACTER_LENGTH >> 8), uint8_t(FPS_CHARACTER_LENGTH & 0xFFU)
+    };
+
+    //state is only moved past a record once all of it is written, so a resumed
+    //backup writes a short record again from its start
+    if(output.write(recordHeader, 4) != 4) {
+      return FPS_OUTPUT_FAIL;
+    }
+
+    response = exportCharacter(1, &output); //the file goes straight to the output
+
+    if(response != FPS_RESP_OK) {
+      return response;
+    }
+
+    if(characterLength != FPS_CHARACTER_LENGTH) {
+      #ifdef FPS_DEBUG
+        debugPort.print(F("Unexpected character file length = "));
+        debugPort.println(characterLength);
+      #endif
+      return FPS_BAD_BACKUP;
+    }
+
+    uint16_t checksum = recordHeader[0] + recordHeader[1] + recordHeader[2] + recordHeader[3] + dataStreamChecksum;
+    uint8_t recordChecksum[2] = {uint8_t(checksum >> 8), uint8_t(checksum & 0xFFU)};
+
+    if(output.write(recordChecksum, 2) != 2) {
+      return FPS_OUTPUT_FAIL;
+    }
+
+    state->length += FPS_BACKUP_RECORD_OVERHEAD + FPS_CHARACTER_LENGTH;
+    state->templateCount++;
+    state->checksum += checksum;
+    copiedCount++;
+    state->location++;
+  }
+
+  uint8_t endRecord[FPS_BACKUP_RECORD_OVERHEAD] = {
+    uint8_t(FPS_BACKUP_END_LOCATION >> 8), uint8_t(FPS_BACKUP_END_LOCATION & 0xFFU),
+    uint8_t(state->templateCount >> 8), uint8_t(state->templateCount & 0xFFU), 0, 0
+  };
+  uint16_t endChecksum = endRecord[0] + endRecord[1] + endRecord[2] + endRecord[3] + state->checksum;
+  endRecord[4] = uint8_t(endChecksum >> 8);
+  endRecord[5] = uint8_t(endChecksum & 0xFFU);
+
+  if(output.write(endRecord, FPS_BACKUP_RECORD_OVERHEAD) != FPS_BACKUP_RECORD_OVERHEAD) {
+    return FPS_OUTPUT_FAIL;
+  }
+
+  state->length += FPS_BACKUP_RECORD_OVERHEAD;
+  state->finished = true;
+
+  #ifdef FPS_DEBUG
+    debugPort.print(F("Library backup complete. templateCount = "));
+    debugPort.println(state->templateCount);
+  #endif
+
+  return FPS_RESP_OK;
+}
+
+//=========================================================================//
+//move the location forward to the next one that holds a template, reading
+//the index table pages as needed. the location will be past lastLocation if
+//there are no more templates. indexPage is the page already in indexTable, or
+//-1 if none
+
+uint8_t R30X_FPS::findTemplate (uint16_t* location, uint16_t lastLocation, uint8_t* indexTable, int16_t* indexPage) {
+  while(*location <= lastLocation) {
+    uint16_t slot = *location - 1;  //the index table counts from 0
+
+    if((slot / FPS_INDEX_PAGE_SIZE) != *indexPage) {
+      *indexPage = slot / FPS_INDEX_PAGE_SIZE;
+      uint8_t response = readIndexTable(*indexPage, indexTable);
+
+      if(response != FPS_RESP_OK) {
+        *indexPage = -1;
+        return response;
+      }
+    }
+
+    uint8_t bit = slot % FPS_INDEX_PAGE_SIZE;
+
+    if(indexTable[bit >> 3] & (1 << (bit & 7))) { //the location holds a template
+      return FPS_RESP_OK;
+    }
+
+    (*location)++;
+  }
+
+  return FPS_RESP_OK;
+}
+
+#if !defined(__AVR__)
+
+//=========================================================================//
+//copy every template in the library to a template store, with the location
+//as the id. the store must be opened or formatted first. this reads the
+//library only once, so the store can then be used as the source for cloning
+//the library to other sensors. not on AVR, where the template buffer would
+//take a quarter of the RAM
+
+uint8_t R30X_FPS::exportLibrary (FPS_TemplateStore* store) {
+  if(store == NULL) {
+    return FPS_BAD_VALUE;
+  }
+
+  uint8_t response = readSysPara();  //for the library size
+
+  if(response != FPS_RESP_OK) {
+    return response;
+  }
+
+  uint8_t characterBuffer[FPS_CHARACTER_LENGTH];
+  uint8_t indexTable[FPS_INDEX_TABLE_LENGTH];
+  int16_t indexPage = -1;
+  uint16_t location = 1;
+  uint16_t lastLocation = librarySize;
+
+  while(true) {
+    response = findTemplate(&location, lastLocation, indexTable, &indexPage);
+
+    if(response != FPS_RESP_OK) {
+      return response;
+    }
+
+    if(location > lastLocation) { //no more templates
+      break;
+    }
+
+    response = loadTemplate(1, location);
+
+    if(response == FPS_RESP_OK) {
+      response = exportCharacter(1, characterBuffer, FPS_CHARACTER_LENGTH);
+    }
+
+    if(response != FPS_RESP_OK) {
+      return response;
+    }
+
+    if(characterLength != FPS_CHARACTER_LENGTH) {
+      return FPS_BAD_BACKUP;
+    }
+
+    response = store->add(location, characterBuffer, FPS_CHARACTER_LENGTH);
+
+    if(response != FPS_RESP_OK) {
+      return response;
+    }
+
+    location++;
+  }
+
+  return FPS_RESP_OK;
+}
+
+//=========================================================================//
+//copy the templates from a backup image made by backupLibrary() to the same
+//locations of the library. the other locations are left as they are. each
+//record is checked before it is saved. the image is only complete when the
+//end record is read and it matches the templates copied, so an image that
+//ends early gives FPS_BAD_BACKUP. start with a cleared state and call until
+//state->finished is true. if a call fails, seek the input back to
+//state->length and call again to resume. not on AVR, for the same reason as
+//exportLibrary()
+
+uint8_t R30X_FPS::restoreLibrary (Stream& input, FPS_BackupState* state, uint16_t maxTemplates) {
+  if(state == NULL) {
+    return FPS_BAD_VALUE;
+  }
+
+  if(state->finished) {
+    return FPS_RESP_OK;
+  }
+
+  uint8_t response;
+
+  if(state->length == 0) { //new restore
+    uint8_t header[FPS_BACKUP_HEADER_LENGTH];
+
+    if(input.readBytes(header, FPS_BACKUP_HEADER_LENGTH) != FPS_BACKUP_HEADER_LENGTH) {
+      return FPS_BAD_BACKUP;
+    }
+
+    FPS_PacketView headerView(header, FPS_BACKUP_HEADER_LENGTH);
+
+    if((headerView.getLong(0) != FPS_BACKUP_MAGIC) || (headerView.getByte(4) != FPS_BACKUP_VERSION)) {
+      #ifdef FPS_DEBUG
+        debugPort.println(F("Not a valid backup image."));
+      #endif
+      return FPS_BAD_BACKUP;
+    }
+
+    state->location = 1;
+    state->librarySize = headerView.getWord(6);
+    state->templateCount = 0;
+    state->checksum = 0;
+    state->length = FPS_BACKUP_HEADER_LENGTH;
+  }
+
+  uint16_t copiedCount = 0;
+
+  while(true) {
+    if((maxTemplates != 0) && (copiedCount >= maxTemplates)) {
+      return FPS_RESP_OK;
+    }
+
+    uint8_t recordHeader[4];
+
+    if(input.readBytes(recordHeader, 4) != 4) { //the image ended without the end record
+      #ifdef FPS_DEBUG
+        debugPort.println(F("Backup image is cut off."));
+      #endif
+      return FPS_BAD_BACKUP;
+    }
+
+    FPS_PacketView recordView(recordHeader, 4);
+    uint16_t location = recordView.getWord(0);
+    uint16_t length = recordView.getWord(2);
+
+    if(location == FPS_BACKUP_END_LOCATION) { //end of the image, the length is the template count
+      uint8_t recordChecksum[2];
+      uint16_t checksum = recordHeader[0] + recordHeader[1] + recordHeader[2] + recordHeader[3] + state->checksum;
+
+      if((input.readBytes(recordChecksum, 2) != 2) || (FPS_PacketView(recordChecksum, 2).getWord(0) != checksum) || (length != state->templateCount)) {
+        #ifdef FPS_DEBUG
+          debugPort.println(F("Backup end record does not match the templates."));
+        #endif
+        return FPS_BAD_BACKUP;
+      }
+
+      state->length += FPS_BACKUP_RECORD_OVERHEAD;
+      break;
+    }
+
+    if((length == 0) || (length > FPS_CHARACTER_LENGTH)) {
+      return FPS_BAD_BACKUP;
+    }
+
+    uint8_t characterBuffer[FPS_CHARACTER_LENGTH];  //read first, so that it can be sent again if the module rejects it
+    uint8_t recordChecksum[2];
+
+    if((input.readBytes(characterBuffer, length) != length) || (input.readBytes(recordChecksum, 2) != 2)) {
+      return FPS_BAD_BACKUP;
+    }
+
+    uint16_t checksum = recordHeader[0] + recordHeader[1] + recordHeader[2] + recordHeader[3] + copyWithChecksum(NULL, characterBuffer, length);
+
+    if(FPS_PacketView(recordChecksum, 2).getWord(0) != checksum) {
+      #ifdef FPS_DEBUG
+        debugPort.print(F("Backup record failed the check. location = #"));
+        debugPort.println(location);
+      #endif
+      return FPS_BAD_BACKUP;
+    }
+
+    response = importCharacter(1, characterBuffer, length);
+
+    if(response != FPS_RESP_OK) {
+      return response;
+    }
+
+    response = saveTemplate(1, location);
+
+    if(response != FPS_RESP_OK) {
+      return response;
+    }
+
+    state->location = location + 1;
+    state->length += FPS_BACKUP_RECORD_OVERHEAD + length;
+    state->templateCount++;
+    state->checksum += checksum;
+    copiedCount++;
+  }
+
+  state->finished = true;
+
+  #ifdef FPS_DEBUG
+    debugPort.print(F("Library restore complete. templateCount = "));
+    debugPort.println(state->templateCount);
+  #endif
+
+  return FPS_RESP_OK;
+}
+
+#endif
+
+//=========================================================================//
+//scans the fingerprint and finds a match within specified range
+//timeout = 100-25500 milliseconds
+//startId = #1 to librarySize
+//range = 1 to librarySize
+
+uint8_t R30X_FPS::captureAndRangeSearch (uint16_t captureTimeout, uint16_t startLocation, uint16_t count) {
+  if(captureTimeout > 25500) { //25500 is the max timeout the device supports
+    #ifdef FPS_DEBUG
+      debugPort.println(F("Capture and range search failed."));
+      debugPort.println(F("Bad capture timeout."));
+      debugPort.print(F("captureTimeout = "));
+      debugPort.println(captureTimeout);
+    #endif
+    return FPS_BAD_VALUE;
+  }
+
+  if((startLocation > librarySize) || (startLocation < 1)) { //if not in the library
+    #ifdef FPS_DEBUG
+      debugPort.println(F("Capture and range search failed."));
+      debugPort.println(F("Bad start ID"));
+      debugPort.print(F("startId = #"));
+      debugPort.println(startLocation);
+    #endif
+
+    return FPS_BAD_VALUE;
+  }
+
+  if((uint32_t(startLocation) + count) > (uint32_t(librarySize) + 1)) { //if range overflows the library
+    #ifdef FPS_DEBUG
+      debugPort.println(F("Capture and range search failed."));
+      debugPort.println(F("startLocation + count can't be greater than librarySize + 1."));
+      debugPort.print(F("startLocation = #"));
+      debugPort.println(startLocation);
+      debugPort.print(F("count = "));
+      debugPort.println(count);
+      debugPort.print(F("startLocation + count = "));
+      debugPort.println(startLocation + count);
+    #endif
+    return FPS_BAD_VALUE;
+  }
+
+  uint8_t dataArray[5] = {0}; //need 5 bytes here
+
+  //generate the data array
+  dataArray[0] = uint8_t(captureTimeout / 140);
+  dataArray[1] = ((startLocation-1) >> 8) & 0xFFU;  //high byte
+  dataArray[2] = uint8_t((startLocation-1) & 0xFFU);  //low byte
+  dataArray[3] = (count >> 8) & 0xFFU; //high byte
+  dataArray[4] = uint8_t(count & 0xFFU); //low byte
+
+  #ifdef FPS_DEBUG
+    debugPort.println(F("Starting capture and range search."));
+    debugPort.print(F("captureTimeout = "));
+    debugPort.println(captureTimeout);
+    debugPort.print(F("startLocation = #"));
+    debugPort.println(startLocation);
+    debugPort.print(F("count = "));
+    debugPort.println(count);
+    debugPort.print(F("startLocation + count = "));
+    debugPort.println(startLocation + count);
+  #endif
+
+  sendCommand<FPS_CMD_SCANANDRANGESEARCH>(dataArray); //send the command, there's no additional data
+  uint8_t response = receivePacket(captureTimeout + 100); //read response
 
   if(response == FPS_RX_OK) { //if the response packet is valid
     if(rxConfirmationCode == FPS_RESP_OK) { //the confirm code will be saved when the response is received
-      fingerId = (uint16_t(rxDataBuffer[3]) << 8) + rxDataBuffer[2];  //add high byte and low byte
-      fingerId += 1;  //because IDs start from #1
-      matchScore = (uint16_t(rxDataBuffer[1]) << 8) + rxDataBuffer[0];  //add high byte and low byte
-      
+      FPS_PacketView packet = getPacketView();
+      fingerId = packet.getWord(0) + 1;  //because IDs start from #1
+      matchScore = packet.getWord(2);  //data length will be 4 here
+
       #ifdef FPS_DEBUG
-        debugPort.println(F("Buffer content found in library."));
+        debugPort.println(F("Capture and range search successful."));
         debugPort.print(F("fingerId = #"));
         debugPort.println(fingerId);
         debugPort.print(F("matchScore = "));
         debugPort.println(matchScore);
       #endif
 
-      return FPS_RESP_OK; //just the confirmation code only
+      return FPS_RESP_OK;
     }
     else {
-      //fingerId = 0 doesn't mean the match was found at location 0
-      //instead it means an error. check the confirmation code to determine the problem
       fingerId = 0;
       matchScore = 0;
 
@@ -1876,8 +2739,54 @@ uint8_t R30X_FPS::searchLibrary (uint8_t bufferId, uint16_t startLocation, uint1
         debugPort.print(F("rxConfirmationCode = "));
         debugPort.println(rxConfirmationCode, HEX);
       #endif
-      
-      return rxConfirmationCode;
+
+      return rxConfirmationCode;  //setting was unsuccessful and so send confirmation code
+    }
+  }
+  else {
+    return response; //return packet receive error code
+  }
+}
+
+//=========================================================================//
+//scans the fingerprint and finds a match within the full range of library
+//a timeout can not be specified here
+
+uint8_t R30X_FPS::captureAndFullSearch () {
+  #ifdef FPS_DEBUG
+    debugPort.println(F("Starting capture and full search."));
+  #endif
+
+  sendCommand<FPS_CMD_SCANANDFULLSEARCH>(); //send the command, there's no additional data
+  uint8_t response = receivePacket(3000); //read response
+
+  if(response == FPS_RX_OK) { //if the response packet is valid
+    if(rxConfirmationCode == FPS_RESP_OK) { //the confirm code will be saved when the response is received
+      FPS_PacketView packet = getPacketView();
+      fingerId = packet.getWord(0) + 1;  //because IDs start from #1
+      matchScore = packet.getWord(2);  //data length will be 4 here
+
+      #ifdef FPS_DEBUG
+        debugPort.println(F("Capture and full search successful."));
+        debugPort.print(F("fingerId = #"));
+        debugPort.println(fingerId);
+        debugPort.print(F("matchScore = "));
+        debugPort.println(matchScore);
+      #endif
+
+      return FPS_RESP_OK;
+    }
+    else {
+      fingerId = 0;
+      matchScore = 0;
+
+      #ifdef FPS_DEBUG
+        debugPort.println(F("Fingerprint not found."));
+        debugPort.print(F("rxConfirmationCode = "));
+        debugPort.println(rxConfirmationCode, HEX);
+      #endif
+
+      return rxConfirmationCode;  //setting was unsuccessful and so send confirmation code
     }
   }
   else {
@@ -1885,6 +2794,3076 @@ uint8_t R30X_FPS::searchLibrary (uint8_t bufferId, uint16_t startLocation, uint1
   }
 }
 
+//=========================================================================//
+//scan the fingerprint, generate an image and store it in the image buffer
+
+uint8_t R30X_FPS::generateImage (uint32_t timeout) {
+  #ifdef FPS_DEBUG
+    debugPort.println(F("Generating fingerprint image.."));
+  #endif
+
+  sendCommand<FPS_CMD_SCANFINGER>(); //send the command, there's no additional data
+  uint8_t response = receivePacket(timeout); //read response
+
+  if(response == FPS_RX_OK) { //if the response packet is valid
+    if(rxConfirmationCode == FPS_RESP_OK) { //the confirm code will be saved when the response is received
+      #ifdef FPS_DEBUG
+        debugPort.println(F("Image saved to buffer successfully."));
+      #endif
+      return FPS_RESP_OK; //just the confirmation code only
+    }
+    else {
+      #ifdef FPS_DEBUG
+        debugPort.println(F("Generating fingerprint failed."));
+        debugPort.print(F("rxConfirmationCode = "));
+        debugPort.println(rxConfirmationCode, HEX);
+      #endif
+      return rxConfirmationCode;  //setting was unsuccessful and so send confirmation code
+    }
+  }
+  else {
+    return response; //return packet receive error code
+  }
+}
+
+//=========================================================================//
+//use the touch output of the sensor to know when a finger is placed. the pin
+//is low when a finger is on the sensor. the sensor is not polled until then.
+//each sensor has its own flag, so several sensors can have touch pins. where
+//the interrupt handler can't take an argument, one of FPS_TOUCH_SLOTS fixed
+//handlers is given to the sensor, and the pin is only read if none is free
+
+void R30X_FPS::setTouchPin (uint8_t pin, uint8_t activeLevel) {
+  if(touchPin != FPS_NO_PIN) {  //release the previous pin
+    int interruptNumber = digitalPinToInterrupt(touchPin);
+    if(interruptNumber >= 0) {
+      detachInterrupt(interruptNumber);
+    }
+    #if !defined(ESP32) && !defined(ESP8266)
+      if(touchSlot >= 0) {
+        touchSensors[touchSlot] = NULL;
+        touchSlot = -1;
+      }
+    #endif
+  }
+
+  touchPin = pin;
+  touchActiveLevel = activeLevel;
+  touchEventFlag = false;
+
+  if(touchPin != FPS_NO_PIN) {
+    pinMode(touchPin, INPUT_PULLUP);
+
+    int interruptNumber = digitalPinToInterrupt(touchPin);
+    if(interruptNumber < 0) { //not all pins can interrupt
+      return;
+    }
+
+    #if defined(ESP32) || defined(ESP8266)
+      attachInterruptArg(interruptNumber, touchEvent, this, (activeLevel == LOW) ? FALLING : RISING);
+    #else
+      static void (*const handlers[FPS_TOUCH_SLOTS])(void) = {touchEvent0, touchEvent1, touchEvent2, touchEvent3};
+
+      for(uint8_t i=0; i < FPS_TOUCH_SLOTS; i++) {
+        if(touchSensors[i] == NULL) {
+          touchSensors[i] = this;
+          touchSlot = i;
+          attachInterrupt(interruptNumber, handlers[i], (activeLevel == LOW) ? FALLING : RISING);
+          return;
+        }
+      }
+      #ifdef FPS_DEBUG
+        debugPort.println(F("No free touch interrupt slot, the pin will be read instead."));
+      #endif
+    #endif
+  }
+}
+
+//=========================================================================//
+//interrupt handlers of the touch pin. they only set the flag of the sensor
+
+#if defined(ESP32) || defined(ESP8266)
+  void IRAM_ATTR R30X_FPS::touchEvent (void* sensor) {
+    ((R30X_FPS*) sensor)->touchEventFlag = true;
+  }
+#else
+  R30X_FPS* R30X_FPS::touchSensors[FPS_TOUCH_SLOTS] = {NULL};
+
+  void R30X_FPS::touchEvent0 (void) {
+    touchSensors[0]->touchEventFlag = true;
+  }
+
+  void R30X_FPS::touchEvent1 (void) {
+    touchSensors[1]->touchEventFlag = true;
+  }
+
+  void R30X_FPS::touchEvent2 (void) {
+    touchSensors[2]->touchEventFlag = true;
+  }
+
+  void R30X_FPS::touchEvent3 (void) {
+    touchSensors[3]->touchEventFlag = true;
+  }
+#endif
+
+//=========================================================================//
+//returns true if the touch pin says a finger is on the sensor, or if there's no
+//touch pin and we have to ask the sensor
+
+bool R30X_FPS::isTouched (void) {
+  if(touchPin == FPS_NO_PIN) {
+    return true;
+  }
+
+  if(touchEventFlag) {
+    touchEventFlag = false;
+    return true;
+  }
+
+  return (digitalRead(touchPin) == touchActiveLevel);
+}
+
+//=========================================================================//
+//discard anything in the serial buffer, such as a late response to a command
+//that timed out. the byte the module sends when it starts up can be among
+//them, so the session is ended if it is seen. a late response that happens to
+//contain the same byte only costs one more password verification
+
+void R30X_FPS::flushInput (void) {
+  bool resetSeen = false;
+
+  while(availableInput() > 0) {
+    if(readInput() == FPS_ID_POWERON) {
+      resetSeen = true;
+    }
+  }
+
+  if(resetSeen) {
+    endSession();
+  }
+}
+
+//=========================================================================//
+//no. of received bytes waiting to be read, from the ring if the receive
+//callback is in use
+
+int R30X_FPS::availableInput (void) {
+  #ifdef FPS_RX_EVENTS
+    if(rxEventSemaphore != NULL) {
+      if(rxRing.available() == 0) {
+        fillRing(); //there may be bytes the ring had no room for
+      }
+
+      return rxRing.available();
+    }
+  #endif
+
+  return mySerial->available();
+}
+
+//=========================================================================//
+//read a received byte, from the ring if the receive callback is in use.
+//-1 if there's none
+
+int R30X_FPS::readInput (void) {
+  #ifdef FPS_RX_EVENTS
+    if(rxEventSemaphore != NULL) {
+      return rxRing.read();
+    }
+  #endif
+
+  return mySerial->read();
+}
+
+//=========================================================================//
+//wait for a finger and capture its image to the image buffer. the capture
+//attempts are sent back-to-back with a short deadline each, so the image is
+//captured as soon as possible after the finger is placed. the interval between
+//the attempts grows while the sensor stays idle and is reset when a finger is
+//detected. if a touch pin is set, the sensor is only polled when it is touched.
+//timeout is in milliseconds. 0 means wait forever
+
+uint8_t R30X_FPS::waitForFinger (uint32_t timeout) {
+  #ifdef FPS_DEBUG
+    debugPort.println(F("Waiting for finger.."));
+  #endif
+
+  uint32_t startTime = millis();
+  uint8_t timeoutCount = 0;
+
+  if((millis() - lastFingerTime) < FPS_PRESENCE_ACTIVE_PERIOD) { //recently active
+    presenceInterval = FPS_PRESENCE_FAST_INTERVAL;
+  }
+
+  while((timeout == 0) || ((millis() - startTime) < timeout)) {
+    if(isTouched()) {
+      flushInput();
+      uint8_t response = generateImage(FPS_PRESENCE_ATTEMPT_TIMEOUT);
+
+      if(response == FPS_RESP_OK) {
+        lastFingerTime = millis();
+        presenceInterval = FPS_PRESENCE_FAST_INTERVAL;
+        return FPS_RESP_OK;
+      }
+      else if(response == FPS_RX_TIMEOUT) {
+        timeoutCount++;
+
+        if(timeoutCount >= 2) { //the sensor is not responding
+          return FPS_RX_TIMEOUT;
+        }
+      }
+      else if((response != FPS_RESP_NOFINGER) && (response != FPS_RESP_ENROLLFAIL)) { //anything other than no finger or bad capture
+        return response;
+      }
+      else {
+        timeoutCount = 0;
+      }
+
+      //back off while idle
+      if((millis() - lastFingerTime) >= FPS_PRESENCE_ACTIVE_PERIOD) {
+        presenceInterval += FPS_PRESENCE_INTERVAL_STEP;
+
+        if(presenceInterval > FPS_PRESENCE_SLOW_INTERVAL) {
+          presenceInterval = FPS_PRESENCE_SLOW_INTERVAL;
+        }
+      }
+
+      delay(presenceInterval);
+    }
+    else {
+      delay(1); //the touch pin is cheap to check
+    }
+  }
+
+  #ifdef FPS_DEBUG
+    debugPort.println(F("No finger detected."));
+  #endif
+
+  return FPS_RESP_NOFINGER;
+}
+
+//=========================================================================//
+//export the image stored in the image buffer to the computer
+//the image is 256 x 288 pixels, sent as 4-bit pixels packed two per byte, over
+//a series of data packets. if a buffer is supplied, the image is saved to it.
+//the quality metrics are calculated as the packets arrive regardless, so the
+//image can be checked with checkImageQuality() without holding it in memory
+
+uint8_t R30X_FPS::exportImage (uint8_t* imageBuffer, uint32_t bufferLength) {
+  #ifdef FPS_DEBUG
+    debugPort.println(F("Exporting fingerprint image.."));
+  #endif
+
+  sendCommand<FPS_CMD_EXPORTIMAGE>(); //send the command, there's no additional data
+  uint8_t response = receivePacket(); //read response
+
+  if(response == FPS_RX_OK) { //if the response packet is valid
+    if(rxConfirmationCode == FPS_RESP_OK) { //the confirm code will be saved when the response is received
+      resetImageQuality();
+      response = receiveDataStream(imageBuffer, bufferLength, NULL, &imageLength, true);
+
+      if(response != FPS_RESP_OK) {
+        #ifdef FPS_DEBUG
+          debugPort.println(F("Exporting image failed."));
+          debugPort.print(F("Bytes received = "));
+          debugPort.println(imageLength);
+        #endif
+        return response;
+      }
+
+      finishImageQuality();
+
+      #ifdef FPS_DEBUG
+        debugPort.println(F("Exporting image successful."));
+        debugPort.print(F("imageLength = "));
+        debugPort.println(imageLength);
+        debugPort.print(F("imageContrast = "));
+        debugPort.println(imageContrast);
+        debugPort.print(F("imageCoverage = "));
+        debugPort.println(imageCoverage);
+        debugPort.print(F("imageClarity = "));
+        debugPort.println(imageClarity);
+      #endif
+
+      return FPS_RESP_OK;
+    }
+    else {
+      #ifdef FPS_DEBUG
+        debugPort.println(F("Exporting image failed."));
+        debugPort.print(F("rxConfirmationCode = "));
+        debugPort.println(rxConfirmationCode, HEX);
+      #endif
+      return rxConfirmationCode;  //setting was unsuccessful and so send confirmation code
+    }
+  }
+  else {
+    return response; //return packet receive error code
+  }
+}
+
+//=========================================================================//
+//receive the data packets the module sends after acknowledging an export
+//command, until the end packet. the data is saved to the buffer as long as
+//there's room, written to the output if there's one, and is added to the image
+//quality metrics if it is an image. if the output fails to take a packet, the
+//rest of the stream is still received so that the next command isn't mixed up
+//with it, and FPS_OUTPUT_FAIL is returned
+
+uint8_t R30X_FPS::receiveDataStream (uint8_t* dataBuffer, uint32_t bufferLength, Print* dataOutput, uint32_t* dataLength, bool imageData) {
+  *dataLength = 0;
+  dataStreamChecksum = 0;
+  bool outputFailed = false;
+
+  while(true) { //the module starts sending the data packets right after the acknowledgement
+    uint8_t response = receivePacket();
+
+    if(response != FPS_RX_OK) {
+      return response;
+    }
+
+    if((rxPacketType != FPS_ID_DATAPACKET) && (rxPacketType != FPS_ID_ENDDATAPACKET)) {
+      return FPS_RX_WRONG_RESPONSE;
+    }
+
+    //data packets have no confirmation code, so the data starts right after the length bytes
+    uint8_t* packetData = rxFrameBuffer + FPS_FRAME_HEADER_LENGTH;
+    uint32_t packetLength = rxDataBufferLength + 1;
+
+    if((dataBuffer != NULL) && (*dataLength < bufferLength)) {
+      uint32_t copyLength = ((bufferLength - *dataLength) < packetLength) ? (bufferLength - *dataLength) : packetLength;
+      memcpy(dataBuffer + *dataLength, packetData, copyLength);
+    }
+
+    if((dataOutput != NULL) && !outputFailed) {
+      if(dataOutput->write(packetData, packetLength) != packetLength) {
+        outputFailed = true;  //the output is broken, don't write the rest after a gap
+      }
+    }
+
+    if(imageData) {
+      for(uint32_t i=0; i < packetLength; i++) {
+        updateImageQuality(packetData[i]);
+      }
+    }
+
+    *dataLength += packetLength;
+    dataStreamChecksum += rxConfirmationCode + rxDataChecksum; //the first byte is held as the confirmation code
+
+    if(rxPacketType == FPS_ID_ENDDATAPACKET) { //last packet
+      if(outputFailed) {
+        #ifdef FPS_DEBUG
+          debugPort.println(F("Writing the data to the output failed."));
+        #endif
+        return FPS_OUTPUT_FAIL;
+      }
+
+      return FPS_RESP_OK;
+    }
+  }
+}
+
+//=========================================================================//
+//clear the image quality accumulators before a new image is received
+
+void R30X_FPS::resetImageQuality (void) {
+  for(uint8_t i=0; i < 16; i++) {
+    imageHistogram[i] = 0;
+  }
+
+  imageGradientSum = 0;
+  imageGradientCount = 0;
+  imagePixelColumn = 0;
+  imagePreviousPixel = 0;
+  imageContrast = 0;
+  imageCoverage = 0;
+  imageClarity = 0;
+}
+
+//=========================================================================//
+//accumulate the quality metrics for a byte of image data. each byte holds two
+//pixels, the high nibble being the first. the histogram is built directly from
+//the nibbles so that the image never needs to be unpacked
+
+void R30X_FPS::updateImageQuality (uint8_t pixelPair) {
+  uint8_t pixels[2] = {uint8_t(pixelPair >> 4), uint8_t(pixelPair & 0x0FU)};
+
+  for(uint8_t i=0; i < 2; i++) {
+    imageHistogram[pixels[i]]++;
+
+    //ridge clarity is the average level change between neighbouring pixels on
+    //the finger. the first pixel of a row has no left neighbour
+    if(imagePixelColumn > 0) {
+      if((pixels[i] < FPS_IMAGE_BACKGROUND_LEVEL) || (imagePreviousPixel < FPS_IMAGE_BACKGROUND_LEVEL)) {
+        imageGradientSum += (pixels[i] > imagePreviousPixel) ? (pixels[i] - imagePreviousPixel) : (imagePreviousPixel - pixels[i]);
+        imageGradientCount++;
+      }
+    }
+
+    imagePreviousPixel = pixels[i];
+    imagePixelColumn++;
+
+    if(imagePixelColumn == FPS_IMAGE_WIDTH) {
+      imagePixelColumn = 0;
+    }
+  }
+}
+
+//=========================================================================//
+//calculate the final quality metrics from the accumulators. all the values
+//are in percentage
+
+void R30X_FPS::finishImageQuality (void) {
+  uint32_t pixelCount = 0;
+  uint32_t fingerCount = 0;
+
+  for(uint8_t i=0; i < 16; i++) {
+    pixelCount += imageHistogram[i];
+
+    if(i < FPS_IMAGE_BACKGROUND_LEVEL) {
+      fingerCount += imageHistogram[i];
+    }
+  }
+
+  if(pixelCount == 0) {
+    return;
+  }
+
+  //contrast is the spread between the darkest and brightest 5% of the pixels
+  uint32_t tailCount = pixelCount / 20;
+  uint32_t runningCount = 0;
+  uint8_t lowLevel = 0;
+  uint8_t highLevel = 15;
+
+  for(uint8_t i=0; i < 16; i++) {
+    runningCount += imageHistogram[i];
+    if(runningCount > tailCount) {
+      lowLevel = i;
+      break;
+    }
+  }
+
+  runningCount = 0;
+
+  for(int8_t i=15; i >= 0; i--) {
+    runningCount += imageHistogram[i];
+    if(runningCount > tailCount) {
+      highLevel = i;
+      break;
+    }
+  }
+
+  imageContrast = (highLevel > lowLevel) ? uint8_t((uint16_t(highLevel - lowLevel) * 100) / 15) : 0;
+  imageCoverage = uint8_t((fingerCount * 100) / pixelCount);
+
+  if(imageGradientCount > 0) {
+    imageClarity = uint8_t((imageGradientSum * 100) / (imageGradientCount * 15));
+  }
+}
+
+//=========================================================================//
+//check the quality metrics of the last exported image against the thresholds.
+//a capture that fails here is not worth converting to a character file
+
+uint8_t R30X_FPS::checkImageQuality (uint8_t minContrast, uint8_t minCoverage, uint8_t minClarity) {
+  if((imageContrast < minContrast) || (imageCoverage < minCoverage) || (imageClarity < minClarity)) {
+    #ifdef FPS_DEBUG
+      debugPort.println(F("Image quality check failed."));
+      debugPort.print(F("imageContrast = "));
+      debugPort.println(imageContrast);
+      debugPort.print(F("imageCoverage = "));
+      debugPort.println(imageCoverage);
+      debugPort.print(F("imageClarity = "));
+      debugPort.println(imageClarity);
+    #endif
+
+    return FPS_BAD_IMAGE;
+  }
+
+  return FPS_RESP_OK;
+}
+
+//=========================================================================//
+//import an image from a buffer to the image buffer of the sensor.
+//the image must be in the same format exportImage() produces
+
+uint8_t R30X_FPS::importImage (uint8_t* imageBuffer, uint32_t imageLength) {
+  if(imageBuffer == NULL) {
+    return FPS_BAD_VALUE;
+  }
+
+  uint8_t response;
+  uint8_t attempt = 0;
+
+  do {  //the buffer can be sent again if the module rejects it
+    response = importImage(imageBuffer, NULL, imageLength);
+  } while(retryStream(response, FPS_CMD_IMPORTIMAGE, &attempt));
+
+  return response;
+}
+
+//=========================================================================//
+//import an image from a stream (eg. a file on SD card) to the image buffer
+//of the sensor. the image is read in chunks so that it never needs to be in
+//memory as a whole
+
+uint8_t R30X_FPS::importImage (Stream* imageSource, uint32_t imageLength) {
+  if(imageSource == NULL) {
+    return FPS_BAD_VALUE;
+  }
+
+  return importImage(NULL, imageSource, imageLength);
+}
+
+//=========================================================================//
+//send the import command and stream the image from either of the sources
+
+uint8_t R30X_FPS::importImage (uint8_t* imageBuffer, Stream* imageSource, uint32_t imageLength) {
+  if((imageLength == 0) || (imageLength > FPS_IMAGE_LENGTH)) {
+    #ifdef FPS_DEBUG
+      debugPort.println(F("Importing image failed."));
+      debugPort.println(F("Bad image length."));
+      debugPort.print(F("imageLength = "));
+      debugPort.println(imageLength);
+    #endif
+    return FPS_BAD_VALUE;
+  }
+
+  #ifdef FPS_DEBUG
+    debugPort.println(F("Importing fingerprint image.."));
+  #endif
+
+  sendCommand<FPS_CMD_IMPORTIMAGE>(); //send the command, there's no additional data
+  uint8_t response = receivePacket(); //read response
+
+  if(response == FPS_RX_OK) { //if the response packet is valid
+    if(rxConfirmationCode == FPS_RESP_OK) { //the module is now ready to accept the data packets
+      response = sendDataStream(imageBuffer, imageSource, imageLength);
+
+      #ifdef FPS_DEBUG
+        if(response == FPS_RESP_OK) {
+          debugPort.println(F("Importing image successful."));
+        }
+        else {
+          debugPort.println(F("Importing image failed."));
+        }
+      #endif
+
+      return response;
+    }
+    else {
+      #ifdef FPS_DEBUG
+        debugPort.println(F("Importing image failed."));
+        debugPort.print(F("rxConfirmationCode = "));
+        debugPort.println(rxConfirmationCode, HEX);
+      #endif
+      return rxConfirmationCode;  //setting was unsuccessful and so send confirmation code
+    }
+  }
+  else {
+    return response; //return packet receive error code
+  }
+}
+
+//=========================================================================//
+//write the start code, device address, packet type and packet length to the
+//start of the frame buffer. returns the no. of bytes written
+
+uint16_t R30X_FPS::buildFrameHeader (uint8_t type, uint16_t packetLength) {
+  txFrameBuffer[0] = startCode[1]; //high byte is sent first
+  txFrameBuffer[1] = startCode[0];
+  txFrameBuffer[2] = deviceAddress[3]; //high byte is sent first
+  txFrameBuffer[3] = deviceAddress[2];
+  txFrameBuffer[4] = deviceAddress[1];
+  txFrameBuffer[5] = deviceAddress[0];
+  txFrameBuffer[6] = type;
+  txFrameBuffer[7] = uint8_t(packetLength >> 8); //high byte is sent first
+  txFrameBuffer[8] = uint8_t(packetLength & 0xFFU);
+
+  return FPS_FRAME_HEADER_LENGTH;
+}
+
+//=========================================================================//
+//copy a block of packet data and return the 16-bit sum of its bytes. the copy
+//and the checksum are done in the same pass. destination can be the same as
+//the source, or NULL to only calculate the sum
+
+uint16_t R30X_FPS::copyWithChecksum (uint8_t* destination, const uint8_t* source, uint16_t length) {
+  uint16_t sum = 0;
+  uint16_t i = 0;
+
+  #ifndef __AVR__
+    //32-bit cores can add four bytes at once. the even and odd bytes of a word
+    //are added in two 16-bit lanes. a lane gains at most 510 per word, so the
+    //lanes are folded into the sum every 128 words before they can overflow
+    while((i + 4) <= length) {
+      uint32_t laneSum = 0;
+      uint16_t blockEnd = ((length - i) > 512) ? (i + 512) : (length & ~3U);
+
+      for(; i < blockEnd; i += 4) {
+        uint32_t word;
+        memcpy(&word, source + i, 4); //unaligned safe, compiles to a single load where possible
+        if(destination != NULL) {
+          memcpy(destination + i, &word, 4);
+        }
+        laneSum += (word & 0x00FF00FFUL) + ((word >> 8) & 0x00FF00FFUL);
+      }
+      sum += uint16_t(laneSum & 0xFFFFU) + uint16_t(laneSum >> 16);
+    }
+  #endif
+
+  for(; i < length; i++) {
+    if(destination != NULL) {
+      destination[i] = source[i];
+    }
+    sum += source[i];
+  }
+  return sum;
+}
+
+//=========================================================================//
+//send a data packet to the FPS. unlike command packets, data packets have
+//no instruction code and the data is sent in the same order as in the buffer.
+//if the data is already in the frame buffer after the header, it is not copied
+
+uint8_t R30X_FPS::sendDataPacket (uint8_t type, uint8_t* data, uint16_t dataLength) {
+  if(dataLength > FPS_MAX_DATA_LENGTH) {
+    return FPS_BAD_VALUE;
+  }
+
+  uint16_t packetLength = dataLength + 2; //2 bytes for checksum
+  uint16_t packetChecksum = type + (packetLength >> 8) + (packetLength & 0xFFU);
+  uint16_t frameLength = buildFrameHeader(type, packetLength);
+  uint8_t* frameData = txFrameBuffer + frameLength;
+
+  packetChecksum += copyWithChecksum(frameData, data, dataLength);  //data can already be in the frame
+
+  frameLength += dataLength;
+  txFrameBuffer[frameLength++] = uint8_t(packetChecksum >> 8);
+  txFrameBuffer[frameLength++] = uint8_t(packetChecksum & 0xFFU);
+
+  mySerial->write(txFrameBuffer, frameLength);
+
+  #ifdef FPS_STATS
+    FPS_CommandStats* stats = getCommandStats(lastCommand);
+    if(stats != NULL) {
+      stats->bytesSent += frameLength;
+    }
+  #endif
+
+  return FPS_RX_OK;
+}
+
+//=========================================================================//
+//split the data from a buffer or a stream into packets of dataPacketLength
+//and send them. the last packet is marked as the end packet
+
+uint8_t R30X_FPS::sendDataStream (uint8_t* dataBuffer, Stream* dataSource, uint32_t dataLength) {
+  uint8_t* packetBuffer = txFrameBuffer + FPS_FRAME_HEADER_LENGTH;  //stream data is read straight into the frame
+  uint32_t sentLength = 0;
+
+  while(sentLength < dataLength) {
+    uint16_t chunkLength = dataPacketLength;
+    uint8_t packetType = FPS_ID_DATAPACKET;
+
+    if((dataLength - sentLength) <= chunkLength) { //last packet
+      chunkLength = dataLength - sentLength;
+      packetType = FPS_ID_ENDDATAPACKET;
+    }
+
+    uint8_t* chunk;
+
+    if(dataBuffer != NULL) {
+      chunk = dataBuffer + sentLength;  //send directly from the buffer
+    }
+    else {
+      if(dataSource->readBytes(packetBuffer, chunkLength) != chunkLength) { //source ended early
+        #ifdef FPS_DEBUG
+          debugPort.println(F("Data source ended early."));
+          debugPort.print(F("Bytes sent = "));
+          debugPort.println(sentLength);
+        #endif
+        return FPS_BAD_VALUE;
+      }
+      chunk = packetBuffer;
+    }
+
+    sendDataPacket(packetType, chunk, chunkLength);
+    sentLength += chunkLength;
+
+    uint8_t response = waitStreamGap();
+
+    if(response != FPS_RESP_OK) { //back off quickly
+      streamGap = ((uint32_t(streamGap) * 2 + FPS_STREAM_GAP_STEP) > FPS_STREAM_MAX_GAP) ? FPS_STREAM_MAX_GAP : (streamGap * 2 + FPS_STREAM_GAP_STEP);
+
+      #ifdef FPS_DEBUG
+        debugPort.print(F("Data packet rejected. Bytes sent = "));
+        debugPort.print(sentLength);
+        debugPort.print(F(", response = "));
+        debugPort.print(response, HEX);
+        debugPort.print(F(", new streamGap = "));
+        debugPort.println(streamGap);
+      #endif
+
+      return response;
+    }
+  }
+
+  streamGap = (streamGap > FPS_STREAM_GAP_STEP) ? (streamGap - FPS_STREAM_GAP_STEP) : 0;  //and speed up slowly
+
+  #ifdef FPS_DEBUG
+    debugPort.print(F("Data packets sent. Bytes sent = "));
+    debugPort.println(sentLength);
+  #endif
+
+  return FPS_RESP_OK;
+}
+
+//=========================================================================//
+//wait streamGap microseconds after a data packet, watching for the module
+//rejecting it. the module doesn't answer the data packets it accepts, so any
+//packet received here is a rejection. returns FPS_RESP_OK if there was none
+
+uint8_t R30X_FPS::waitStreamGap (void) {
+  uint32_t startTime = micros();
+
+  do {
+    if(availableInput() > 0) {
+      uint8_t response = waitPacket(FPS_STREAM_REJECT_TIMEOUT); //not receivePacket(), which may send the command again
+
+      if(response != FPS_RX_OK) {
+        return response;
+      }
+
+      if(rxConfirmationCode != FPS_RESP_OK) {
+        return rxConfirmationCode;
+      }
+    }
+  } while((micros() - startTime) < streamGap);
+
+  return FPS_RESP_OK;
+}
+
+//=========================================================================//
+//returns true if an import from a buffer should be sent again. only a
+//rejected transfer is repeated, and only that one object, not the whole
+//batch it is part of. the stream is slower the next time
+
+bool R30X_FPS::retryStream (uint8_t response, uint8_t command, uint8_t* attempt) {
+  if((response != FPS_RESP_PACKETACCEPTFAIL) || (*attempt >= FPS_STREAM_RETRIES)) {
+    return false;
+  }
+
+  (*attempt)++;
+
+  #ifdef FPS_STATS
+    FPS_CommandStats* stats = getCommandStats(command);
+    if(stats != NULL) {
+      stats->retries++;
+    }
+  #else
+    (void) command;
+  #endif
+
+  #ifdef FPS_DEBUG
+    debugPort.print(F("Sending the data again. attempt = "));
+    debugPort.println(*attempt);
+  #endif
+
+  return true;
+}
+
+//=========================================================================//
+//generate a character file from image stored in image buffer and store it in
+//one of the two character buffers
+
+uint8_t R30X_FPS::generateCharacter (uint8_t bufferId) {
+  if(!((bufferId > 0) && (bufferId < 3))) { //if the value is not 1 or 2
+    #ifdef FPS_DEBUG
+      debugPort.println(F("Generating character file failed."));
+      debugPort.println(F("Bad value. bufferId can only be 1 or 2."));
+      debugPort.print(F("bufferId = "));
+      debugPort.println(bufferId);
+    #endif
+
+    return FPS_BAD_VALUE;
+  }
+  uint8_t dataBuffer[1] = {bufferId}; //create data array
+
+  #ifdef FPS_DEBUG
+    debugPort.println(F("Generating character file.."));
+    debugPort.print(F("Character bufferId = "));
+    debugPort.println(bufferId);
+  #endif
+  
+  sendCommand<FPS_CMD_IMAGETOCHARACTER>(dataBuffer);
+  uint8_t response = receivePacket(); //read response
+
+  if(response == FPS_RX_OK) { //if the response packet is valid
+    if(rxConfirmationCode == FPS_RESP_OK) { //the confirm code will be saved when the response is received
+      #ifdef FPS_DEBUG
+        debugPort.println(F("Generating character file successful."));
+      #endif
+      return FPS_RESP_OK; //just the confirmation code only
+    }
+    else {
+      #ifdef FPS_DEBUG
+        debugPort.println(F("Generating character file failed."));
+        debugPort.print(F("rxConfirmationCode = "));
+        debugPort.println(rxConfirmationCode, HEX);
+
+        if(rxConfirmationCode == FPS_RESP_OVERDISORDERFAIL2) {
+          debugPort.println(F("Character file overly disordered."));
+        }
+
+        if(rxConfirmationCode == FPS_RESP_FEATUREFAIL) {
+          debugPort.println(F("Character file feature fail."));
+        }
+
+        if(rxConfirmationCode == FPS_RESP_IMAGEGENERATEFAIL) {
+          debugPort.println(F("Valid image not available."));
+        }
+
+      #endif
+
+      return rxConfirmationCode;  //setting was unsuccessful and so send confirmation code
+    }
+  }
+  else {
+    return response; //return packet receive error code
+  }
+}
+
+//=========================================================================//
+//combine the two character files from buffers and generate a template
+//the template will be saved to the both the buffers
+
+uint8_t R30X_FPS::generateTemplate () {
+  #ifdef FPS_DEBUG
+    debugPort.println(F("Generating template from char buffers.."));
+  #endif
+
+  sendCommand<FPS_CMD_GENERATETEMPLATE>(); //send the command, there's no additional data
+  uint8_t response = receivePacket(); //read response
+
+  if(response == FPS_RX_OK) { //if the response packet is valid
+    if(rxConfirmationCode == FPS_RESP_OK) { //the confirm code will be saved when the response is received
+      #ifdef FPS_DEBUG
+        debugPort.println(F("Generating template successful."));
+      #endif
+      return FPS_RESP_OK; //just the confirmation code only
+    }
+    else {
+      #ifdef FPS_DEBUG
+        debugPort.println(F("Generating template failed."));
+        debugPort.print(F("rxConfirmationCode = "));
+        debugPort.println(rxConfirmationCode, HEX);
+      #endif
+      return rxConfirmationCode;  //setting was unsuccessful and so send confirmation code
+    }
+  }
+  else {
+    return response; //return packet receive error code
+  }
+}
+
+//=========================================================================//
+//export the character file in one of the two buffers to the computer. the
+//file is sent as a series of data packets. if a buffer is supplied, the file
+//is saved to it. characterLength is set to the no. of bytes received
+
+uint8_t R30X_FPS::exportCharacter (uint8_t bufferId, uint8_t* characterBuffer, uint32_t bufferLength) {
+  return exportCharacter(bufferId, characterBuffer, bufferLength, NULL);
+}
+
+//=========================================================================//
+//export the character file in one of the two buffers straight to a file or
+//a port, without holding it in memory
+
+uint8_t R30X_FPS::exportCharacter (uint8_t bufferId, Print* characterOutput) {
+  if(characterOutput == NULL) {
+    return FPS_BAD_VALUE;
+  }
+
+  return exportCharacter(bufferId, NULL, 0, characterOutput);
+}
+
+//=========================================================================//
+//send the export command and receive the character file to either of the
+//destinations
+
+uint8_t R30X_FPS::exportCharacter (uint8_t bufferId, uint8_t* characterBuffer, uint32_t bufferLength, Print* characterOutput) {
+  if(!((bufferId > 0) && (bufferId < 3))) { //if the value is not 1 or 2
+    #ifdef FPS_DEBUG
+      debugPort.println(F("Exporting character file failed."));
+      debugPort.println(F("Bad value. bufferId can only be 1 or 2."));
+      debugPort.print(F("bufferId = "));
+      debugPort.println(bufferId);
+    #endif
+
+    return FPS_BAD_VALUE;
+  }
+
+  uint8_t dataArray[1] = {bufferId}; //create data array
+
+  #ifdef FPS_DEBUG
+    debugPort.println(F("Exporting character file.."));
+    debugPort.print(F("Character bufferId = "));
+    debugPort.println(bufferId);
+  #endif
+
+  sendCommand<FPS_CMD_EXPORTTEMPLATE>(dataArray);
+  uint8_t response = receivePacket(); //read response
+
+  if(response == FPS_RX_OK) { //if the response packet is valid
+    if(rxConfirmationCode == FPS_RESP_OK) { //the data packets follow the acknowledgement
+      response = receiveDataStream(characterBuffer, bufferLength, characterOutput, &characterLength, false);
+
+      #ifdef FPS_DEBUG
+        if(response == FPS_RESP_OK) {
+          debugPort.println(F("Exporting character file successful."));
+        }
+        else {
+          debugPort.println(F("Exporting character file failed."));
+        }
+        debugPort.print(F("characterLength = "));
+        debugPort.println(characterLength);
+      #endif
+
+      return response;
+    }
+    else {
+      #ifdef FPS_DEBUG
+        debugPort.println(F("Exporting character file failed."));
+        debugPort.print(F("rxConfirmationCode = "));
+        debugPort.println(rxConfirmationCode, HEX);
+      #endif
+      return rxConfirmationCode;  //setting was unsuccessful and so send confirmation code
+    }
+  }
+  else {
+    return response; //return packet receive error code
+  }
+}
+
+//=========================================================================//
+//import a character file from a buffer to one of the two buffers of the
+//sensor. the file must be in the same format exportCharacter() produces
+
+uint8_t R30X_FPS::importCharacter (uint8_t bufferId, uint8_t* characterBuffer, uint32_t characterLength) {
+  if(characterBuffer == NULL) {
+    return FPS_BAD_VALUE;
+  }
+
+  uint8_t response;
+  uint8_t attempt = 0;
+
+  do {  //the buffer can be sent again if the module rejects it
+    response = importCharacter(bufferId, characterBuffer, NULL, characterLength);
+  } while(retryStream(response, FPS_CMD_IMPORTTEMPLATE, &attempt));
+
+  return response;
+}
+
+//=========================================================================//
+//import a character file from a stream (eg. a file on SD card) to one of the
+//two buffers of the sensor
+
+uint8_t R30X_FPS::importCharacter (uint8_t bufferId, Stream* characterSource, uint32_t characterLength) {
+  if(characterSource == NULL) {
+    return FPS_BAD_VALUE;
+  }
+
+  return importCharacter(bufferId, NULL, characterSource, characterLength);
+}
+
+//=========================================================================//
+//send the import command and stream the character file from either of the
+//sources
+
+uint8_t R30X_FPS::importCharacter (uint8_t bufferId, uint8_t* characterBuffer, Stream* characterSource, uint32_t characterLength) {
+  if((!((bufferId > 0) && (bufferId < 3))) || (characterLength == 0) || (characterLength > FPS_CHARACTER_LENGTH)) {
+    #ifdef FPS_DEBUG
+      debugPort.println(F("Importing character file failed."));
+      debugPort.println(F("Bad value. bufferId can only be 1 or 2, and the length up to 512 bytes."));
+      debugPort.print(F("bufferId = "));
+      debugPort.println(bufferId);
+      debugPort.print(F("characterLength = "));
+      debugPort.println(characterLength);
+    #endif
+    return FPS_BAD_VALUE;
+  }
+
+  uint8_t dataArray[1] = {bufferId}; //create data array
+
+  #ifdef FPS_DEBUG
+    debugPort.println(F("Importing character file.."));
+    debugPort.print(F("Character bufferId = "));
+    debugPort.println(bufferId);
+  #endif
+
+  sendCommand<FPS_CMD_IMPORTTEMPLATE>(dataArray);
+  uint8_t response = receivePacket(); //read response
+
+  if(response == FPS_RX_OK) { //if the response packet is valid
+    if(rxConfirmationCode == FPS_RESP_OK) { //the module is now ready to accept the data packets
+      response = sendDataStream(characterBuffer, characterSource, characterLength);
+
+      #ifdef FPS_DEBUG
+        if(response == FPS_RESP_OK) {
+          debugPort.println(F("Importing character file successful."));
+        }
+        else {
+          debugPort.println(F("Importing character file failed."));
+        }
+      #endif
+
+      return response;
+    }
+    else {
+      #ifdef FPS_DEBUG
+        debugPort.println(F("Importing character file failed."));
+        debugPort.print(F("rxConfirmationCode = "));
+        debugPort.println(rxConfirmationCode, HEX);
+      #endif
+      return rxConfirmationCode;  //setting was unsuccessful and so send confirmation code
+    }
+  }
+  else {
+    return response; //return packet receive error code
+  }
+}
+
+//=========================================================================//
+//store the contents of one of the two template (character) buffers to a
+//location on the fingerprint library
+
+uint8_t R30X_FPS::saveTemplate (uint8_t bufferId, uint16_t location) {
+  uint8_t response = beginSaveTemplate(bufferId, location);
+
+  if(response != FPS_RX_OK) {
+    return response;
+  }
+
+  return finishSaveTemplate(receivePacket()); //read response
+}
+
+//=========================================================================//
+//start storing a template buffer to the library without waiting for the
+//response. the buffer and location are kept for finishSaveTemplate()
+
+uint8_t R30X_FPS::beginSaveTemplate (uint8_t bufferId, uint16_t location) {
+  if(!((bufferId > 0) && (bufferId < 3))) { //if the value is not 1 or 2
+    #ifdef FPS_DEBUG
+      debugPort.println(F("Storing template failed."));
+      debugPort.println(F("Bad value. bufferId can only be 1 or 2."));
+      debugPort.print(F("bufferId = "));
+      debugPort.println(bufferId);
+    #endif
+
+    return FPS_BAD_VALUE;
+  }
+
+  if((location > 1000) || (location < 1)) { //if the value is not in range
+    #ifdef FPS_DEBUG
+      debugPort.println(F("Generating template failed."));
+      debugPort.println(F("Bad value. location must be #1 to #1000."));
+      debugPort.print(F("location = "));
+      debugPort.println(location);
+    #endif
+
+    return FPS_BAD_VALUE;
+  }
+
+  #ifdef FPS_DEBUG
+    debugPort.println(F("Saving template.."));
+  #endif
+
+  uint8_t dataArray[3] = {0}; //create data array
+  dataArray[0] = bufferId;  //sent first
+  dataArray[1] = ((location-1) >> 8) & 0xFFU; //high byte of location
+  dataArray[2] = ((location-1) & 0xFFU); //low byte of location
+
+  pendingBufferId = bufferId;
+  pendingLocation = location;
+
+  uint8_t response = sendCommand<FPS_CMD_STORETEMPLATE>(dataArray); //send the command and data
+
+  if(response != FPS_RX_OK) {
+    return response;
+  }
+
+  beginReceive();
+  return FPS_RX_OK;
+}
+
+//=========================================================================//
+//check the response of beginSaveTemplate()
+
+uint8_t R30X_FPS::finishSaveTemplate (uint8_t response) {
+  if(response == FPS_RX_OK) { //if the response packet is valid
+    if(rxConfirmationCode == FPS_RESP_OK) { //the confirm code will be saved when the response is received
+      charBufferSlot[pendingBufferId - 1] = pendingLocation;  //the buffer now holds the same as the location
+
+      #ifdef FPS_DEBUG
+        debugPort.println(F("Storing template successful."));
+        debugPort.print(F("Saved to #"));
+        debugPort.println(pendingLocation);
+      #endif
+      return FPS_RESP_OK; //just the confirmation code only
+    }
+    else {
+      #ifdef FPS_DEBUG
+        debugPort.println(F("Storing template failed."));
+        debugPort.print(F("rxConfirmationCode = "));
+        debugPort.println(rxConfirmationCode, HEX);
+      #endif
+      return rxConfirmationCode;  //setting was unsuccessful and so send confirmation code
+    }
+  }
+  else {
+    return response; //return packet receive error code
+  }
+}
+
+//=========================================================================//
+//load the contents from a location on the library to one of the two
+//template/character buffers
+
+uint8_t R30X_FPS::loadTemplate (uint8_t bufferId, uint16_t location) {
+  if((bufferId > 0) && (bufferId < 3) && (location != 0) && (charBufferSlot[bufferId - 1] == location)) { //already loaded, no need to read the flash again
+    #ifdef FPS_DEBUG
+      debugPort.print(F("Template #"));
+      debugPort.print(location);
+      debugPort.print(F(" is already in buffer "));
+      debugPort.println(bufferId);
+    #endif
+
+    return FPS_RESP_OK;
+  }
+
+  uint8_t response = beginLoadTemplate(bufferId, location);
+
+  if(response != FPS_RX_OK) {
+    return response;
+  }
+
+  return finishLoadTemplate(receivePacket()); //read response
+}
+
+//=========================================================================//
+//start loading a template from the library to a buffer without waiting for
+//the response. unlike loadTemplate(), the command is always sent, even if the
+//location is already in the buffer
+
+uint8_t R30X_FPS::beginLoadTemplate (uint8_t bufferId, uint16_t location) {
+  if(!((bufferId > 0) && (bufferId < 3))) { //if the value is not 1 or 2
+    #ifdef FPS_DEBUG
+      debugPort.println(F("Loading template failed."));
+      debugPort.println(F("Bad value. bufferId can only be 1 or 2."));
+      debugPort.print(F("bufferId = "));
+      debugPort.println(bufferId);
+    #endif
+
+    return FPS_BAD_VALUE;
+  }
+
+  if((location > 1000) || (location < 1)) { //if the value is not in range
+    #ifdef FPS_DEBUG
+      debugPort.println(F("Loading template failed."));
+      debugPort.println(F("Bad value. location must be #1 to #1000."));
+      debugPort.print(F("location = "));
+      debugPort.println(location);
+    #endif
+
+    return FPS_BAD_VALUE;
+  }
+
+  uint8_t dataArray[3] = {0}; //create data array
+  dataArray[0] = bufferId;  //sent first
+  dataArray[1] = ((location-1) >> 8) & 0xFFU; //high byte of location
+  dataArray[2] = ((location-1) & 0xFFU); //low byte of location
+
+  #ifdef FPS_DEBUG
+    debugPort.println(F("Loading template.."));
+  #endif
+
+  pendingBufferId = bufferId;
+  pendingLocation = location;
+
+  uint8_t response = sendCommand<FPS_CMD_LOADTEMPLATE>(dataArray); //send the command and data
+
+  if(response != FPS_RX_OK) {
+    return response;
+  }
+
+  beginReceive();
+  return FPS_RX_OK;
+}
+
+//=========================================================================//
+//check the response of beginLoadTemplate()
+
+uint8_t R30X_FPS::finishLoadTemplate (uint8_t response) {
+  if(response == FPS_RX_OK) { //if the response packet is valid
+    if(rxConfirmationCode == FPS_RESP_OK) { //the confirm code will be saved when the response is received
+      charBufferSlot[pendingBufferId - 1] = pendingLocation;
+
+      #ifdef FPS_DEBUG
+        debugPort.println(F("Loading template successful."));
+        debugPort.print(F("Loaded #"));
+        debugPort.print(pendingLocation);
+        debugPort.print(F(" to buffer "));
+        debugPort.println(pendingBufferId);
+      #endif
+
+      return FPS_RESP_OK; //just the confirmation code only
+    }
+    else {
+      #ifdef FPS_DEBUG
+        debugPort.println(F("Loading template failed."));
+        debugPort.print(F("rxConfirmationCode = "));
+        debugPort.println(rxConfirmationCode, HEX);
+      #endif
+      return rxConfirmationCode;  //setting was unsuccessful and so send confirmation code
+    }
+  }
+  else {
+    return response; //return packet receive error code
+  }
+}
+
+//=========================================================================//
+//delete a set of templates saved in the flash memory
+
+uint8_t R30X_FPS::deleteTemplate (uint16_t startLocation, uint16_t count) {
+  if((startLocation > 1000) || (startLocation < 1)) { //if the value is not 1 or 2
+    #ifdef FPS_DEBUG
+      debugPort.println(F("Deleting template failed."));
+      debugPort.println(F("Bad value. Start location must be #1 to #1000."));
+      debugPort.print(F("startLocation = "));
+      debugPort.println(startLocation);
+    #endif
+
+    return FPS_BAD_VALUE;
+  }
+
+  if((count + startLocation) > 1001) { //if the value is not in range
+    #ifdef FPS_DEBUG
+      debugPort.println(F("Deleting template failed."));
+      debugPort.println(F("Bad value. Sum of startLocation and count can't be greater than 1001."));
+      debugPort.print(F("startLocation + count = "));
+      debugPort.println(startLocation + count);
+    #endif
+
+    return FPS_BAD_VALUE;
+  }
+
+  uint8_t dataArray[4] = {0}; //create data array
+  dataArray[0] = ((startLocation-1) >> 8) & 0xFFU; //high byte of location
+  dataArray[1] = ((startLocation-1) & 0xFFU); //low byte of location
+  dataArray[2] = (count >> 8) & 0xFFU; //high byte of total no. of templates to delete
+  dataArray[3] = (count & 0xFFU); //low byte of count
+
+  #ifdef FPS_DEBUG
+    debugPort.println(F("Deleting template.."));
+  #endif
+
+  sendCommand<FPS_CMD_DELETETEMPLATE>(dataArray); //send the command and data
+  uint8_t response = receivePacket(); //read response
+
+  if(response == FPS_RX_OK) { //if the response packet is valid
+    if(rxConfirmationCode == FPS_RESP_OK) { //the confirm code will be saved when the response is received
+     #ifdef FPS_DEBUG
+        debugPort.println(F("Deleting template successful."));
+        debugPort.print(F("From #"));
+        debugPort.print(startLocation);
+        debugPort.print(F(" to #"));
+        debugPort.println(startLocation + count - 1);
+      #endif
+      return FPS_RESP_OK; //just the confirmation code only
+    }
+    else {
+      #ifdef FPS_DEBUG
+        debugPort.println(F("Deleting template failed."));
+        debugPort.print(F("rxConfirmationCode = "));
+        debugPort.println(rxConfirmationCode, HEX);
+      #endif
+      return rxConfirmationCode;  //setting was unsuccessful and so send confirmation code
+    }
+  }
+  else {
+    return response; //return packet receive error code
+  }
+}
+
+//=========================================================================//
+//deletes all the templates stored in the library
+
+uint8_t R30X_FPS::clearLibrary () {
+  #ifdef FPS_DEBUG
+    debugPort.println(F("Clearing library.."));
+  #endif
+
+  sendCommand<FPS_CMD_CLEARLIBRARY>(); //send the command
+  uint8_t response = receivePacket(); //read response
+
+  if(response == FPS_RX_OK) { //if the response packet is valid
+    if(rxConfirmationCode == FPS_RESP_OK) { //the confirm code will be saved when the response is received
+      #ifdef FPS_DEBUG
+        debugPort.println(F("Clearing library successful."));
+      #endif
+      return FPS_RESP_OK; //just the confirmation code only
+    }
+    else {
+      #ifdef FPS_DEBUG
+        debugPort.println(F("Clearing library failed."));
+        debugPort.print(F("rxConfirmationCode = "));
+        debugPort.println(rxConfirmationCode, HEX);
+      #endif
+      return rxConfirmationCode;  //setting was unsuccessful and so send confirmation code
+    }
+  }
+  else {
+    return response; //return packet receive error code
+  }
+}
+
+//=========================================================================//
+//match the templates stored in the buffers and calculate a match score
+
+uint8_t R30X_FPS::matchTemplates () {
+  uint8_t response = beginMatchTemplates();
+
+  if(response != FPS_RX_OK) {
+    return response;
+  }
+
+  return finishMatchTemplates(receivePacket()); //read response
+}
+
+//=========================================================================//
+//start matching the templates in the buffers without waiting for the score
+
+uint8_t R30X_FPS::beginMatchTemplates (void) {
+  #ifdef FPS_DEBUG
+    debugPort.println(F("Matching templates.."));
+  #endif
+
+  uint8_t response = sendCommand<FPS_CMD_MATCHTEMPLATES>(); //send the command
+
+  if(response != FPS_RX_OK) {
+    return response;
+  }
+
+  beginReceive();
+  return FPS_RX_OK;
+}
+
+//=========================================================================//
+//save the match score from the response of beginMatchTemplates()
+
+uint8_t R30X_FPS::finishMatchTemplates (uint8_t response) {
+  if(response == FPS_RX_OK) { //if the response packet is valid
+    if(rxConfirmationCode == FPS_RESP_OK) { //the confirm code will be saved when the response is received
+      #ifdef FPS_DEBUG
+        debugPort.println(F("Matching templates successful."));
+      #endif
+
+      matchScore = getPacketView().getWord(0);
+      return FPS_RESP_OK; //just the confirmation code only
+    }
+    else {
+      #ifdef FPS_DEBUG
+        debugPort.println(F("The templates do no match."));
+        debugPort.print(F("rxConfirmationCode = "));
+        debugPort.println(rxConfirmationCode, HEX);
+      #endif
+      return rxConfirmationCode;  //setting was unsuccessful and so send confirmation code
+    }
+  }
+  else {
+    return response; //return packet receive error code
+  }
+}
+
+//=========================================================================//
+//searches the contents of one of the two char buffers for a match on the
+//fingerprint library throughout a range
+
+uint8_t R30X_FPS::searchLibrary (uint8_t bufferId, uint16_t startLocation, uint16_t count) {
+  uint8_t response = beginSearchLibrary(bufferId, startLocation, count);
+
+  if(response != FPS_RX_OK) {
+    return response;
+  }
+
+  return finishSearchLibrary(receivePacket()); //read response
+}
+
+//=========================================================================//
+//start searching the library without waiting for the result. poll the
+//response with pollPacket() and pass it to finishSearchLibrary()
+
+uint8_t R30X_FPS::beginSearchLibrary (uint8_t bufferId, uint16_t startLocation, uint16_t count) {
+  if(!((bufferId > 0) && (bufferId < 3))) { //if the value is not 1 or 2
+    #ifdef FPS_DEBUG
+      debugPort.println(F("Searching library failed."));
+      debugPort.println(F("Bad value. bufferId can only be 1 or 2."));
+      debugPort.print(F("bufferId = "));
+      debugPort.println(bufferId);
+    #endif
+    return FPS_BAD_VALUE;
+  }
+
+  if((startLocation > librarySize) || (startLocation < 1)) { //if not in the library
+    #ifdef FPS_DEBUG
+      debugPort.println(F("Searching library failed."));
+      debugPort.println(F("Bad start ID"));
+      debugPort.print(F("startId = #"));
+      debugPort.println(startLocation);
+    #endif
+    return FPS_BAD_VALUE;
+  }
+
+  if((uint32_t(startLocation) + count) > (uint32_t(librarySize) + 1)) { //if range overflows the library
+    #ifdef FPS_DEBUG
+      debugPort.println(F("Searching library failed."));
+      debugPort.println(F("startLocation + count can't be greater than librarySize + 1."));
+      debugPort.print(F("startLocation = #"));
+      debugPort.println(startLocation);
+      debugPort.print(F("count = "));
+      debugPort.println(count);
+      debugPort.print(F("startLocation + count = "));
+      debugPort.println(startLocation + count);
+    #endif
+    return FPS_BAD_VALUE;
+  }
+
+  uint8_t dataArray[5] = {0};
+  dataArray[0] = bufferId;
+  dataArray[1] = ((startLocation-1) >> 8) & 0xFFU;  //high byte
+  dataArray[2] = ((startLocation-1) & 0xFFU); //low byte
+  dataArray[3] = (count >> 8) & 0xFFU; //high byte
+  dataArray[4] = (count & 0xFFU); //low byte
+
+  #ifdef FPS_DEBUG
+    debugPort.println(F("Starting searching library for buffer content."));
+    debugPort.print(F("bufferId = "));
+    debugPort.println(bufferId);
+    debugPort.print(F("startLocation = #"));
+    debugPort.println(startLocation);
+    debugPort.print(F("count = "));
+    debugPort.println(count);
+    debugPort.print(F("startLocation + count = "));
+    debugPort.println(startLocation + count);
+  #endif
+
+  uint8_t response = sendCommand<FPS_CMD_SEARCHLIBRARY>(dataArray); //send the command
+
+  if(response != FPS_RX_OK) {
+    return response;
+  }
+
+  beginReceive();
+  return FPS_RX_OK;
+}
+
+//=========================================================================//
+//extract the result of a search started with beginSearchLibrary()
+
+uint8_t R30X_FPS::finishSearchLibrary (uint8_t response) {
+  if(response == FPS_RX_OK) { //if the response packet is valid
+    if(rxConfirmationCode == FPS_RESP_OK) { //the confirm code will be saved when the response is received
+      FPS_PacketView packet = getPacketView();
+      fingerId = packet.getWord(0) + 1;  //because IDs start from #1
+      matchScore = packet.getWord(2);
+      
+      #ifdef FPS_DEBUG
+        debugPort.println(F("Buffer content found in library."));
+        debugPort.print(F("fingerId = #"));
+        debugPort.println(fingerId);
+        debugPort.print(F("matchScore = "));
+        debugPort.println(matchScore);
+      #endif
+
+      return FPS_RESP_OK; //just the confirmation code only
+    }
+    else {
+      //fingerId = 0 doesn't mean the match was found at location 0
+      //instead it means an error. check the confirmation code to determine the problem
+      fingerId = 0;
+      matchScore = 0;
+
+      #ifdef FPS_DEBUG
+        debugPort.println(F("Fingerprint not found."));
+        debugPort.print(F("rxConfirmationCode = "));
+        debugPort.println(rxConfirmationCode, HEX);
+      #endif
+      
+      return rxConfirmationCode;
+    }
+  }
+  else {
+    return response; //return packet receive error code
+  }
+}
+
+//=========================================================================//
+//capture a finger and search the library for it in one call. if the recent
+//matches are clustered in a part of the library, that part is searched first
+//and the rest only if it is not found there. otherwise the whole library is
+//searched. the result is saved to fingerId and matchScore.
+//timeout is the time to wait for the finger in milliseconds. 0 means forever.
+//a match with a score lower than minScore is treated as not found
+
+uint8_t R30X_FPS::identify (uint32_t timeout, uint16_t minScore) {
+  uint16_t hotStart = 0;
+  uint16_t hotCount = 0;
+  uint8_t response;
+
+  getHotRange(&hotStart, &hotCount);
+
+  #ifdef FPS_DEBUG
+    debugPort.println(F("Identifying finger.."));
+    debugPort.print(F("Hot range = #"));
+    debugPort.print(hotStart);
+    debugPort.print(F(", count = "));
+    debugPort.println(hotCount);
+  #endif
+
+  if((hotCount > 0) && (timeout > 0) && (timeout <= 25500) && (touchPin == FPS_NO_PIN)) {
+    //capture and search the hot range in a single command
+    response = captureAndRangeSearch(timeout, hotStart, hotCount);
+
+    if(response == FPS_RESP_OK) {
+      return finishIdentify(minScore);
+    }
+    else if(response != FPS_RESP_NOTFOUND) {
+      return response;
+    }
+
+    response = generateCharacter(1); //the image is still in the buffer
+  }
+  else {
+    response = waitForFinger(timeout);
+
+    if(response != FPS_RESP_OK) {
+      return response;
+    }
+
+    response = generateCharacter(1);
+
+    if((response == FPS_RESP_OK) && (hotCount > 0)) {
+      response = searchLibrary(1, hotStart, hotCount);
+
+      if(response == FPS_RESP_OK) {
+        return finishIdentify(minScore);
+      }
+      else if(response != FPS_RESP_NOTFOUND) {
+        return response;
+      }
+    }
+  }
+
+  if(response != FPS_RESP_OK) {
+    return response;
+  }
+
+  if(hotCount == 0) { //search everything
+    response = searchLibrary(1, 1, librarySize);
+  }
+  else {
+    response = FPS_RESP_NOTFOUND;
+
+    if(hotStart > 1) { //before the hot range
+      response = searchLibrary(1, 1, hotStart - 1);
+    }
+
+    if((response == FPS_RESP_NOTFOUND) && ((hotStart + hotCount) <= librarySize)) { //after the hot range
+      response = searchLibrary(1, hotStart + hotCount, librarySize - (hotStart + hotCount) + 1);
+    }
+  }
+
+  if(response == FPS_RESP_OK) {
+    return finishIdentify(minScore);
+  }
+
+  return response;
+}
+
+//=========================================================================//
+//enroll a finger to a location in the library. the finger is captured twice,
+//and has to be lifted in between. the two captures are combined to a template.
+//timeout is the time to wait for each step in milliseconds. 0 means forever
+
+uint8_t R30X_FPS::enroll (uint16_t location, uint32_t timeout) {
+  #ifdef FPS_DEBUG
+    debugPort.print(F("Enrolling finger to location #"));
+    debugPort.println(location);
+  #endif
+
+  uint8_t response = waitForFinger(timeout);
+
+  if(response != FPS_RESP_OK) {
+    return response;
+  }
+
+  response = generateCharacter(1);
+
+  if(response != FPS_RESP_OK) {
+    return response;
+  }
+
+  #ifdef FPS_DEBUG
+    debugPort.println(F("Remove the finger."));
+  #endif
+
+  uint32_t startTime = millis();
+
+  while(true) { //the same touch should not be captured twice
+    response = generateImage();
+
+    if(response == FPS_RESP_NOFINGER) {
+      break;
+    }
+    else if((response != FPS_RESP_OK) && (response != FPS_RESP_ENROLLFAIL)) {
+      return response;
+    }
+
+    if((timeout > 0) && ((millis() - startTime) >= timeout)) {
+      return FPS_RESP_ENROLLFAIL; //the finger was never lifted
+    }
+
+    delay(FPS_PRESENCE_INTERVAL_STEP);
+  }
+
+  response = waitForFinger(timeout);
+
+  if(response != FPS_RESP_OK) {
+    return response;
+  }
+
+  response = generateCharacter(2);
+
+  if(response != FPS_RESP_OK) {
+    return response;
+  }
+
+  response = generateTemplate();
+
+  if(response != FPS_RESP_OK) {
+    return response;
+  }
+
+  return saveTemplate(1, location);
+}
+
+//=========================================================================//
+//check the score of a match and remember where it was found
+
+uint8_t R30X_FPS::finishIdentify (uint16_t minScore) {
+  if(matchScore < minScore) {
+    #ifdef FPS_DEBUG
+      debugPort.println(F("Match score too low."));
+      debugPort.print(F("matchScore = "));
+      debugPort.println(matchScore);
+    #endif
+
+    fingerId = 0;
+    matchScore = 0;
+    return FPS_RESP_NOTFOUND;
+  }
+
+  identifyHistory[identifyHistoryIndex] = fingerId;
+  identifyHistoryIndex = (identifyHistoryIndex + 1) % FPS_IDENTIFY_HISTORY_LENGTH;
+
+  #ifdef FPS_DEBUG
+    debugPort.println(F("Identifying finger successful."));
+    debugPort.print(F("fingerId = #"));
+    debugPort.println(fingerId);
+    debugPort.print(F("matchScore = "));
+    debugPort.println(matchScore);
+  #endif
+
+  return FPS_RESP_OK;
+}
+
+//=========================================================================//
+//find the part of the library the recent matches came from. the range is only
+//worth searching first if it is a small part of the library. count is 0 if
+//there's no such range
+
+void R30X_FPS::getHotRange (uint16_t* start, uint16_t* count) {
+  uint16_t lowest = 0xFFFFU;
+  uint16_t highest = 0;
+
+  for(uint8_t i=0; i < FPS_IDENTIFY_HISTORY_LENGTH; i++) {
+    if(identifyHistory[i] == 0) { //empty
+      continue;
+    }
+
+    if(identifyHistory[i] < lowest) {
+      lowest = identifyHistory[i];
+    }
+
+    if(identifyHistory[i] > highest) {
+      highest = identifyHistory[i];
+    }
+  }
+
+  *start = 0;
+  *count = 0;
+
+  if((highest == 0) || (highest > librarySize)) {
+    return;
+  }
+
+  if((highest - lowest + 1) <= (librarySize / FPS_IDENTIFY_HOT_RANGE_DIVISOR)) {
+    *start = lowest;
+    *count = highest - lowest + 1;
+  }
+}
+
+//=========================================================================//
+//constructor of the sensor group. the array of sensors must stay valid for as
+//long as the group is used
+
+R30X_FPS_Group::R30X_FPS_Group (R30X_FPS** sensorList, uint8_t count) {
+  sensors = sensorList;
+  sensorCount = (count > FPS_GROUP_MAX_SENSORS) ? FPS_GROUP_MAX_SENSORS : count;
+  completionCallback = NULL;
+  completionContext = NULL;
+  nextIndex = 0;
+  clonedCount = 0;
+  cloneTime = 0;
+  matchIndex = 0;
+  fingerId = 0;
+  matchScore = 0;
+
+  for(uint8_t i=0; i < FPS_GROUP_MAX_SENSORS; i++) {
+    lastResponse[i] = FPS_RX_TIMEOUT;
+  }
+}
+
+//=========================================================================//
+//set the function to be called when the response of a sensor completes
+
+void R30X_FPS_Group::onComplete (FPS_CompletionCallback callback, void* context) {
+  completionCallback = callback;
+  completionContext = context;
+}
+
+//=========================================================================//
+//poll every sensor that is receiving once and dispatch the completed ones.
+//returns the no. of sensors still receiving
+
+uint8_t R30X_FPS_Group::poll (void) {
+  uint8_t pendingCount = 0;
+
+  for(uint8_t i=0; i < sensorCount; i++) {
+    uint8_t index = (nextIndex + i) % sensorCount;
+    R30X_FPS* sensor = sensors[index];
+
+    if(!sensor->isReceiving()) {
+      continue;
+    }
+
+    uint8_t response = sensor->pollPacket();
+
+    if(response == FPS_RX_PENDING) {
+      pendingCount++;
+      continue;
+    }
+
+    if(response == FPS_RX_CANCELLED) { //nobody is waiting for this one
+      continue;
+    }
+
+    lastResponse[index] = response;
+
+    if(completionCallback != NULL) {
+      completionCallback(sensor, index, response, completionContext); //the callback may start a new command
+    }
+
+    if(sensor->isReceiving()) {
+      pendingCount++;
+    }
+  }
+
+  if(sensorCount > 0) {
+    nextIndex = (nextIndex + 1) % sensorCount;
+  }
+
+  return pendingCount;
+}
+
+//=========================================================================//
+//poll until none of the sensors is receiving. the receive timeouts of the
+//sensors make sure this returns
+
+uint8_t R30X_FPS_Group::waitAll (void) {
+  while(poll() > 0) {
+    delay(1);
+  }
+
+  return FPS_RX_OK;
+}
+
+//=========================================================================//
+//returns the no. of sensors still receiving
+
+uint8_t R30X_FPS_Group::receivingCount (void) {
+  uint8_t count = 0;
+
+  for(uint8_t i=0; i < sensorCount; i++) {
+    if(sensors[i]->isReceiving()) {
+      count++;
+    }
+  }
+
+  return count;
+}
+
+#if !defined(__AVR__)
+
+//=========================================================================//
+//identify a finger against the libraries of all the sensors, so that the
+//group holds as many fingerprints as all of them together. the finger is
+//captured on the sensor at sourceIndex, and its character file is imported
+//to buffer 1 of every other sensor. then all the sensors search their whole
+//library at the same time. the first match with a score of at least minScore
+//wins, and the searches still running are cancelled. the result is saved to
+//matchIndex, fingerId and matchScore. the cancelled searches are not waited
+//for, so the result comes as soon as the match is found. their responses are
+//dropped by the next poll() or waitAll(), or when the next command is sent to
+//the sensor, which then waits for the search to finish first. the group holds
+//the character file for this, so it's left out on AVR
+
+uint8_t R30X_FPS_Group::identify (uint8_t sourceIndex, uint32_t timeout, uint16_t minScore) {
+  if(sourceIndex >= sensorCount) {
+    return FPS_BAD_VALUE;
+  }
+
+  waitAll();  //finish the searches cancelled last time
+
+  matchIndex = 0;
+  fingerId = 0;
+  matchScore = 0;
+
+  R30X_FPS* source = sensors[sourceIndex];
+  uint8_t response = source->waitForFinger(timeout);
+
+  if(response == FPS_RESP_OK) {
+    response = source->generateCharacter(1);
+  }
+
+  if((response == FPS_RESP_OK) && (sensorCount > 1)) {  //no need to export if there's no one to send it to
+    response = source->exportCharacter(1, characterData, FPS_CHARACTER_LENGTH);
+
+    if((response == FPS_RESP_OK) && (source->characterLength != FPS_CHARACTER_LENGTH)) { //only that much was copied
+      #ifdef FPS_DEBUG
+        debugPort.print(F("Unexpected character file length = "));
+        debugPort.println(source->characterLength);
+      #endif
+      response = FPS_RESP_TEMPLATEUPLOADFAIL;
+    }
+  }
+
+  if(response != FPS_RESP_OK) {
+    return response;
+  }
+
+  uint64_t searching = 0; //one bit for each sensor taking part in the search
+
+  for(uint8_t i=0; i < sensorCount; i++) {
+    searching |= uint64_t(1) << i;
+    lastResponse[i] = FPS_RESP_OK;
+  }
+
+  if(sensorCount > 1) {
+    broadcastCharacter(sourceIndex, FPS_CHARACTER_LENGTH, &searching);
+  }
+
+  for(uint8_t i=0; i < sensorCount; i++) {
+    if(searching & (uint64_t(1) << i)) {
+      response = sensors[i]->beginSearchLibrary(1, 1, sensors[i]->librarySize);
+
+      if(response != FPS_RX_OK) {
+        lastResponse[i] = response;
+        searching &= ~(uint64_t(1) << i);
+      }
+    }
+  }
+
+  #ifdef FPS_DEBUG
+    debugPort.println(F("Searching all the sensors.."));
+  #endif
+
+  uint8_t pendingCount;
+  bool found = false;
+
+  do {
+    pendingCount = 0;
+
+    for(uint8_t i=0; i < sensorCount; i++) {
+      if(!((searching & (uint64_t(1) << i)) && sensors[i]->isReceiving())) {
+        continue;
+      }
+
+      response = sensors[i]->pollPacket();
+
+      if(response == FPS_RX_PENDING) {
+        pendingCount++;
+        continue;
+      }
+
+      response = sensors[i]->finishSearchLibrary(response);
+
+      if((response == FPS_RESP_OK) && (sensors[i]->matchScore < minScore)) { //not confident enough
+        response = FPS_RESP_NOTFOUND;
+      }
+
+      lastResponse[i] = response;
+
+      if(response == FPS_RESP_OK) {
+        matchIndex = i;
+        fingerId = sensors[i]->fingerId;
+        matchScore = sensors[i]->matchScore;
+        found = true;
+        break;
+      }
+    }
+  } while((pendingCount > 0) && !found);
+
+  if(found) {
+    for(uint8_t i=0; i < sensorCount; i++) {  //cancel the rest
+      if(searching & (uint64_t(1) << i)) {
+        sensors[i]->cancelReceive();
+      }
+    }
+
+    #ifdef FPS_DEBUG
+      debugPort.println(F("Identifying finger successful."));
+      debugPort.print(F("matchIndex = "));
+      debugPort.println(matchIndex);
+      debugPort.print(F("fingerId = #"));
+      debugPort.println(fingerId);
+      debugPort.print(F("matchScore = "));
+      debugPort.println(matchScore);
+    #endif
+
+    return FPS_RESP_OK;
+  }
+
+  for(uint8_t i=0; i < sensorCount; i++) {  //a sensor that couldn't search may have had the finger
+    if((lastResponse[i] != FPS_RESP_OK) && (lastResponse[i] != FPS_RESP_NOTFOUND)) {
+      return lastResponse[i];
+    }
+  }
+
+  return FPS_RESP_NOTFOUND;
+}
+
+//=========================================================================//
+//import the character file in characterData to buffer 1 of every sensor
+//except the source. the import commands are sent first, and then one data
+//packet to each sensor in turn, so that all the ports send at the same time.
+//the sensors that fail have their bit in active cleared and their
+//lastResponse set
+
+void R30X_FPS_Group::broadcastCharacter (uint8_t sourceIndex, uint16_t characterLength, uint64_t* active) {
+  uint8_t dataArray[1] = {1}; //to buffer 1
+  uint8_t response;
+
+  for(uint8_t i=0; i < sensorCount; i++) {
+    targets[i].sentLength = 0;
+
+    if(i == sourceIndex) { //already has it
+      continue;
+    }
+
+    response = sensors[i]->beginCommand(FPS_CMD_IMPORTTEMPLATE, dataArray, 1);
+
+    if(response != FPS_RX_OK) {
+      lastResponse[i] = response;
+      *active &= ~(uint64_t(1) << i);
+    }
+  }
+
+  uint8_t pendingCount;
+
+  do {  //wait until every sensor is ready for the data
+    pendingCount = 0;
+
+    for(uint8_t i=0; i < sensorCount; i++) {
+      if((i == sourceIndex) || !(*active & (uint64_t(1) << i)) || !sensors[i]->isReceiving()) {
+        continue;
+      }
+
+      response = sensors[i]->pollPacket();
+
+      if(response == FPS_RX_PENDING) {
+        pendingCount++;
+        continue;
+      }
+
+      if(response == FPS_RX_OK) {
+        response = sensors[i]->rxConfirmationCode;
+      }
+
+      if(response != FPS_RESP_OK) {
+        lastResponse[i] = response;
+        *active &= ~(uint64_t(1) << i);
+      }
+    }
+  } while(pendingCount > 0);
+
+  uint8_t sendingCount;
+
+  do {
+    sendingCount = 0;
+
+    for(uint8_t i=0; i < sensorCount; i++) {
+      uint16_t sentLength = targets[i].sentLength;
+
+      if((i == sourceIndex) || !(*active & (uint64_t(1) << i)) || (sentLength >= characterLength)) {
+        continue;
+      }
+
+      uint16_t chunkLength = sensors[i]->dataPacketLength;
+      uint8_t packetType = FPS_ID_DATAPACKET;
+
+      if((characterLength - sentLength) <= chunkLength) { //last packet
+        chunkLength = characterLength - sentLength;
+        packetType = FPS_ID_ENDDATAPACKET;
+      }
+
+      sensors[i]->sendDataPacket(packetType, characterData + sentLength, chunkLength);
+      targets[i].sentLength = sentLength + chunkLength;
+      sendingCount++;
+    }
+  } while(sendingCount > 0);
+}
+
+#endif
+
+//=========================================================================//
+//load the templates of a store to all the sensors of the group, with the ids
+//as the library locations. each sensor goes through the templates on its own,
+//so while one sensor is saving a template, another is receiving one. one data
+//packet is sent to each sensor in turn, so that all the ports send at the same
+//time. templateBuffers must have FPS_CHARACTER_LENGTH bytes for each sensor.
+//lastResponse of each sensor is set to its result. returns FPS_RESP_OK if all
+//the sensors got all the templates, or else the first error
+
+uint8_t R30X_FPS_Group::cloneLibrary (FPS_TemplateStore* source, uint8_t* templateBuffers) {
+  if((source == NULL) || (templateBuffers == NULL)) {
+    return FPS_BAD_VALUE;
+  }
+
+  waitAll();  //finish the searches cancelled by identify()
+
+  uint8_t activeCount = sensorCount;
+  uint32_t startTime = millis();
+  clonedCount = 0;
+
+  for(uint8_t i=0; i < sensorCount; i++) {
+    targets[i].record.offset = 0; //scan from the first record
+    targets[i].stage = FPS_CLONE_NEXT;
+    lastResponse[i] = FPS_RESP_OK;
+  }
+
+  while(activeCount > 0) {
+    activeCount = 0;
+
+    for(uint8_t i=0; i < sensorCount; i++) {
+      R30X_FPS* sensor = sensors[i];
+      FPS_CloneTarget* target = &targets[i];
+      uint8_t* templateBuffer = templateBuffers + (uint32_t(i) * FPS_CHARACTER_LENGTH);
+      uint8_t response;
+
+      switch(target->stage) {
+        case FPS_CLONE_NEXT: {
+          bool found;
+
+          do {  //skip the removed templates
+            found = source->nextRecord(&target->record);
+          } while(found && (target->record.flags & FPS_STORE_FLAG_DELETED));
+
+          if(!found) {
+            target->stage = FPS_CLONE_DONE;
+            break;
+          }
+
+          response = source->readRecord(&target->record, templateBuffer, FPS_CHARACTER_LENGTH);
+
+          if((response == FPS_RESP_OK) && (target->record.id == 0)) { //locations start from #1
+            response = FPS_BAD_VALUE;
+          }
+
+          if(response != FPS_RESP_OK) {
+            lastResponse[i] = response;
+            target->stage = FPS_CLONE_DONE;
+            break;
+          }
+
+          target->retries = FPS_CLONE_RETRIES;
+          beginImport(i, target);
+          break;
+        }
+
+        case FPS_CLONE_IMPORT:
+        case FPS_CLONE_SAVE:
+          response = sensor->pollPacket();
+
+          if(response == FPS_RX_PENDING) {
+            break;
+          }
+
+          if(response == FPS_RX_OK) {
+            response = sensor->rxConfirmationCode;
+          }
+
+          if(response != FPS_RESP_OK) {
+            failClone(i, target, response);
+          }
+          else if(target->stage == FPS_CLONE_IMPORT) { //the sensor is ready for the data
+            target->sentLength = 0;
+            target->stage = FPS_CLONE_DATA;
+          }
+          else {  //saved
+            clonedCount++;
+            target->stage = FPS_CLONE_NEXT;
+          }
+          break;
+
+        case FPS_CLONE_DATA: {
+          uint16_t chunkLength = sensor->dataPacketLength;
+          uint8_t packetType = FPS_ID_DATAPACKET;
+
+          if((FPS_CHARACTER_LENGTH - target->sentLength) <= chunkLength) { //last packet
+            chunkLength = FPS_CHARACTER_LENGTH - target->sentLength;
+            packetType = FPS_ID_ENDDATAPACKET;
+          }
+
+          sensor->sendDataPacket(packetType, templateBuffer + target->sentLength, chunkLength);
+          target->sentLength += chunkLength;
+
+          if(target->sentLength >= FPS_CHARACTER_LENGTH) {
+            uint16_t location = target->record.id;
+            uint8_t dataArray[3] = {1, uint8_t((location-1) >> 8), uint8_t((location-1) & 0xFFU)};
+            sensor->beginCommand(FPS_CMD_STORETEMPLATE, dataArray, 3);
+            target->stage = FPS_CLONE_SAVE;
+          }
+          break;
+        }
+      }
+
+      if(target->stage != FPS_CLONE_DONE) {
+        activeCount++;
+      }
+    }
+  }
+
+  cloneTime = millis() - startTime;
+
+  #ifdef FPS_DEBUG
+    debugPort.print(F("Cloning finished. clonedCount = "));
+    debugPort.print(clonedCount);
+    debugPort.print(F(", cloneTime = "));
+    debugPort.println(cloneTime);
+  #endif
+
+  for(uint8_t i=0; i < sensorCount; i++) {
+    if(lastResponse[i] != FPS_RESP_OK) {
+      return lastResponse[i];
+    }
+  }
+
+  return FPS_RESP_OK;
+}
+
+//=========================================================================//
+//send the import command for the template of a target
+
+void R30X_FPS_Group::beginImport (uint8_t index, FPS_CloneTarget* target) {
+  uint8_t dataArray[1] = {1}; //the template is loaded to buffer 1
+  sensors[index]->beginCommand(FPS_CMD_IMPORTTEMPLATE, dataArray, 1);
+  target->stage = FPS_CLONE_IMPORT;
+}
+
+//=========================================================================//
+//send the same template again, or stop cloning to the sensor if it has
+//failed too many times
+
+void R30X_FPS_Group::failClone (uint8_t index, FPS_CloneTarget* target, uint8_t response) {
+  #ifdef FPS_DEBUG
+    debugPort.print(F("Cloning to sensor "));
+    debugPort.print(index);
+    debugPort.print(F(" failed at location #"));
+    debugPort.print(target->record.id);
+    debugPort.print(F(". response = "));
+    debugPort.println(response, HEX);
+  #endif
+
+  if(target->retries > 0) {
+    target->retries--;
+
+    #ifdef FPS_STATS
+      FPS_CommandStats* stats = sensors[index]->getCommandStats(FPS_CMD_IMPORTTEMPLATE);
+      if(stats != NULL) {
+        stats->retries++;
+      }
+    #endif
+
+    beginImport(index, target);
+    return;
+  }
+
+  lastResponse[index] = response;
+  target->stage = FPS_CLONE_DONE;
+}
+
+//=========================================================================//
+//the template store works over a block of memory supplied by the caller. call
+//begin() to open a store already in the memory, or format() to start a new one
+
+FPS_TemplateStore::FPS_TemplateStore (uint8_t* memory, uint32_t size) {
+  this->memory = memory;
+  memorySize = size;
+  usedLength = 0;
+  recordCount = 0;
+  duplicateCount = 0;
+}
+
+//=========================================================================//
+//open the store in the memory. the header is always checked. if verify is
+//true, every record is also checked against its checksum. this is a single
+//sequential pass over the memory, plus a walk up to the original record of
+//each duplicate to make sure the reference points at the start of a record
+
+uint8_t FPS_TemplateStore::begin (bool verify) {
+  usedLength = 0;
+  recordCount = 0;
+  duplicateCount = 0;
+
+  if((memory == NULL) || (memorySize < FPS_STORE_HEADER_LENGTH)) {
+    return FPS_BAD_VALUE;
+  }
+
+  FPS_PacketView header(memory, FPS_STORE_HEADER_LENGTH);
+  uint16_t checksum = 0;
+
+  for(uint8_t i=0; i < (FPS_STORE_HEADER_LENGTH - 2); i++) {
+    checksum += memory[i];
+  }
+
+  if((header.getLong(0) != FPS_STORE_MAGIC) || (header.getByte(4) != FPS_STORE_VERSION) || (header.getWord(14) != checksum)) {
+    #ifdef FPS_DEBUG
+      debugPort.println(F("Template store has no valid header."));
+    #endif
+    return FPS_STORE_CORRUPT;
+  }
+
+  uint16_t headerRecordCount = header.getWord(6);
+  uint32_t headerUsedLength = header.getLong(8);
+
+  if((headerUsedLength < FPS_STORE_HEADER_LENGTH) || (headerUsedLength > memorySize)) {
+    return FPS_STORE_CORRUPT;
+  }
+
+  usedLength = headerUsedLength;
+
+  if(!verify) {
+    recordCount = headerRecordCount;
+    return FPS_RESP_OK;
+  }
+
+  //walk the records to make sure they add up to the header
+  FPS_TemplateRecord record;
+  uint32_t endOffset = FPS_STORE_HEADER_LENGTH; //where the last record ends
+  record.offset = 0;
+
+  while(nextRecord(&record)) {
+    FPS_PacketView recordHeader(memory + record.offset, FPS_STORE_RECORD_HEADER_LENGTH);
+
+    if(recordHeader.getWord(10) != recordChecksum(record.offset)) {
+      #ifdef FPS_DEBUG
+        debugPort.print(F("Template store record failed the check at offset "));
+        debugPort.println(record.offset);
+      #endif
+      usedLength = 0;
+      return FPS_STORE_CORRUPT;
+    }
+
+    if(record.flags & FPS_STORE_FLAG_DUPLICATE) {
+      //a reference can only point back to the start of an earlier record
+      //that holds the same template
+      if((record.payloadLength != 4) || !isOriginal(FPS_PacketView(memory + record.offset + FPS_STORE_RECORD_HEADER_LENGTH, 4).getLong(0), &record)) {
+        #ifdef FPS_DEBUG
+          debugPort.print(F("Template store reference is not valid at offset "));
+          debugPort.println(record.offset);
+        #endif
+        usedLength = 0;
+        recordCount = 0;
+        duplicateCount = 0;
+        return FPS_STORE_CORRUPT;
+      }
+      duplicateCount++;
+    }
+
+    recordCount++;
+    endOffset = record.offset + FPS_STORE_RECORD_HEADER_LENGTH + record.payloadLength;
+  }
+
+  if((recordCount != headerRecordCount) || (endOffset != usedLength)) {
+    #ifdef FPS_DEBUG
+      debugPort.println(F("Template store records do not match the header."));
+    #endif
+    usedLength = 0;
+    recordCount = 0;
+    duplicateCount = 0;
+    return FPS_STORE_CORRUPT;
+  }
+
+  #ifdef FPS_DEBUG
+    debugPort.print(F("Template store opened. recordCount = "));
+    debugPort.println(recordCount);
+  #endif
+
+  return FPS_RESP_OK;
+}
+
+//=========================================================================//
+//clear the store and write a new header
+
+void FPS_TemplateStore::format (void) {
+  usedLength = FPS_STORE_HEADER_LENGTH;
+  recordCount = 0;
+  duplicateCount = 0;
+
+  if((memory == NULL) || (memorySize < FPS_STORE_HEADER_LENGTH)) {
+    usedLength = 0;
+    return;
+  }
+
+  writeHeader();
+}
+
+//=========================================================================//
+//add a template to the end of the store. if an identical template is already
+//in the store, only a reference to it is saved
+
+uint8_t FPS_TemplateStore::add (uint16_t id, const uint8_t* characterData, uint16_t length) {
+  if((characterData == NULL) || (length == 0)) {
+    return FPS_BAD_VALUE;
+  }
+
+  if(usedLength < FPS_STORE_HEADER_LENGTH) { //not opened or formatted
+    return FPS_STORE_CORRUPT;
+  }
+
+  uint32_t recordOffset = usedLength;
+
+  if((memorySize - recordOffset) < (FPS_STORE_RECORD_HEADER_LENGTH + 4)) {
+    return FPS_STORE_FULL;
+  }
+
+  uint8_t* recordHeader = memory + recordOffset;
+  uint8_t* payload = recordHeader + FPS_STORE_RECORD_HEADER_LENGTH;
+  uint32_t templateHash = hash(characterData, length);
+  uint32_t originalOffset = findDuplicate(templateHash, characterData, length);
+  uint8_t flags = 0;
+  uint16_t payloadLength;
+
+  if(originalOffset != 0) {
+    putLong(payload, originalOffset);
+    payloadLength = 4;
+    flags = FPS_STORE_FLAG_DUPLICATE;
+  }
+  else {
+    uint32_t room = memorySize - recordOffset - FPS_STORE_RECORD_HEADER_LENGTH;
+    payloadLength = compress(characterData, length, payload, (room > 0xFFFFU) ? 0xFFFFU : uint16_t(room));
+
+    if(payloadLength == 0) {
+      #ifdef FPS_DEBUG
+        debugPort.println(F("Template store is full."));
+      #endif
+      return FPS_STORE_FULL;
+    }
+  }
+
+  putWord(recordHeader, id);
+  recordHeader[2] = flags;
+  recordHeader[3] = 0;
+  putLong(recordHeader + 4, templateHash);
+  putWord(recordHeader + 8, payloadLength);
+  putWord(recordHeader + 10, recordChecksum(recordOffset));
+
+  usedLength += FPS_STORE_RECORD_HEADER_LENGTH + payloadLength;
+  recordCount++;
+
+  if(flags & FPS_STORE_FLAG_DUPLICATE) {
+    duplicateCount++;
+  }
+
+  writeHeader();  //the header is updated last, so an interrupted add leaves the store as it was
+
+  #ifdef FPS_DEBUG
+    debugPort.print(F("Template added to store. id = "));
+    debugPort.print(id);
+    debugPort.print(F(", stored length = "));
+    debugPort.println(payloadLength);
+  #endif
+
+  return FPS_RESP_OK;
+}
+
+//=========================================================================//
+//read the template most recently added with the id
+
+uint8_t FPS_TemplateStore::get (uint16_t id, uint8_t* characterData, uint16_t length) {
+  FPS_TemplateRecord record;
+  FPS_TemplateRecord latest;
+  bool found = false;
+  record.offset = 0;
+
+  while(nextRecord(&record)) {
+    if((record.id == id) && !(record.flags & FPS_STORE_FLAG_DELETED)) {
+      latest = record;
+      found = true;
+    }
+  }
+
+  if(!found) {
+    return FPS_STORE_NOT_FOUND;
+  }
+
+  return readRecord(&latest, characterData, length);
+}
+
+//=========================================================================//
+//mark all the templates with the id as removed. the space is not reclaimed,
+//and the data stays in place for the references to it
+
+uint8_t FPS_TemplateStore::remove (uint16_t id) {
+  FPS_TemplateRecord record;
+  bool found = false;
+  record.offset = 0;
+
+  while(nextRecord(&record)) {
+    if((record.id == id) && !(record.flags & FPS_STORE_FLAG_DELETED)) {
+      uint8_t* recordHeader = memory + record.offset;
+      recordHeader[2] |= FPS_STORE_FLAG_DELETED;
+      putWord(recordHeader + 10, recordChecksum(record.offset));
+      found = true;
+    }
+  }
+
+  return found ? FPS_RESP_OK : FPS_STORE_NOT_FOUND;
+}
+
+//=========================================================================//
+//move the record to the next one in the store. set the offset of the record
+//to 0 to start from the first record. returns false after the last record
+
+bool FPS_TemplateStore::nextRecord (FPS_TemplateRecord* record) {
+  uint32_t offset = FPS_STORE_HEADER_LENGTH;
+
+  if(record->offset != 0) {
+    offset = record->offset + FPS_STORE_RECORD_HEADER_LENGTH + record->payloadLength;
+  }
+
+  if((offset + FPS_STORE_RECORD_HEADER_LENGTH) > usedLength) {
+    return false;
+  }
+
+  FPS_PacketView recordHeader(memory + offset, FPS_STORE_RECORD_HEADER_LENGTH);
+  uint16_t payloadLength = recordHeader.getWord(8);
+
+  if((offset + FPS_STORE_RECORD_HEADER_LENGTH + payloadLength) > usedLength) { //runs past the end
+    return false;
+  }
+
+  record->offset = offset;
+  record->id = recordHeader.getWord(0);
+  record->flags = recordHeader.getByte(2);
+  record->hash = recordHeader.getLong(4);
+  record->payloadLength = payloadLength;
+  return true;
+}
+
+//=========================================================================//
+//decompress the template of a record. the length must match the length of
+//the template that was added
+
+uint8_t FPS_TemplateStore::readRecord (const FPS_TemplateRecord* record, uint8_t* characterData, uint16_t length) {
+  if((record == NULL) || (characterData == NULL)) {
+    return FPS_BAD_VALUE;
+  }
+
+  uint16_t payloadLength;
+  const uint8_t* payload = getPayload(record->offset, &payloadLength);
+
+  if(payload == NULL) {
+    return FPS_STORE_CORRUPT;
+  }
+
+  if(decompress(payload, payloadLength, characterData, length) != length) {
+    return FPS_STORE_CORRUPT;
+  }
+
+  if(hash(characterData, length) != record->hash) {
+    return FPS_STORE_CORRUPT;
+  }
+
+  return FPS_RESP_OK;
+}
+
+//=========================================================================//
+//write the used part of the memory. this is the complete store, and can be
+//loaded back with load()
+
+uint32_t FPS_TemplateStore::save (Print& output) {
+  if(usedLength < FPS_STORE_HEADER_LENGTH) {
+    return 0;
+  }
+
+  return output.write(memory, usedLength);
+}
+
+//=========================================================================//
+//read a store written by save() into the memory and open it
+
+uint8_t FPS_TemplateStore::load (Stream& input, bool verify) {
+  usedLength = 0;
+
+  if((memory == NULL) || (memorySize < FPS_STORE_HEADER_LENGTH)) {
+    return FPS_BAD_VALUE;
+  }
+
+  if(input.readBytes(memory, FPS_STORE_HEADER_LENGTH) != FPS_STORE_HEADER_LENGTH) {
+    return FPS_STORE_CORRUPT;
+  }
+
+  uint32_t storeLength = FPS_PacketView(memory, FPS_STORE_HEADER_LENGTH).getLong(8);
+
+  if((storeLength < FPS_STORE_HEADER_LENGTH) || (storeLength > memorySize)) {
+    #ifdef FPS_DEBUG
+      debugPort.println(F("Template store does not fit in the memory."));
+    #endif
+    return FPS_STORE_FULL;
+  }
+
+  uint32_t restLength = storeLength - FPS_STORE_HEADER_LENGTH;
+
+  if(input.readBytes(memory + FPS_STORE_HEADER_LENGTH, restLength) != restLength) {
+    return FPS_STORE_CORRUPT;
+  }
+
+  return begin(verify);
+}
+
+//=========================================================================//
+//32-bit FNV-1a hash of the data. identical templates are found by comparing
+//the hashes first
+
+uint32_t FPS_TemplateStore::hash (const uint8_t* data, uint16_t length) {
+  uint32_t value = 2166136261UL;  //FNV offset basis
+
+  for(uint16_t i=0; i < length; i++) {
+    value ^= data[i];
+    value *= 16777619UL;  //FNV prime
+  }
+
+  return value;
+}
+
+//=========================================================================//
+//compress the data with PackBits. a header byte of 0 to 127 is followed by
+//1 to 128 bytes to be copied, and a header byte of 129 to 255 is followed by
+//a single byte to be repeated 2 to 128 times. character files have long runs
+//of zeros, so they shrink well
+
+uint16_t FPS_TemplateStore::compress (const uint8_t* source, uint16_t length, uint8_t* destination, uint16_t maxLength) {
+  uint16_t in = 0;
+  uint16_t out = 0;
+
+  while(in < length) {
+    uint16_t run = 1;
+
+    while(((in + run) < length) && (run < 128) && (source[in + run] == source[in])) {
+      run++;
+    }
+
+    if(run > 1) { //repeated byte
+      if((out + 2) > maxLength) {
+        return 0;
+      }
+
+      destination[out++] = uint8_t(257 - run);
+      destination[out++] = source[in];
+      in += run;
+    }
+    else {  //copy bytes until the next run starts
+      uint16_t start = in;
+      uint16_t count = 0;
+
+      while((in < length) && (count < 128)) {
+        if(((in + 1) < length) && (source[in] == source[in + 1])) {
+          break;
+        }
+        in++;
+        count++;
+      }
+
+      if((out + 1 + count) > maxLength) {
+        return 0;
+      }
+
+      destination[out++] = uint8_t(count - 1);
+      memcpy(destination + out, source + start, count);
+      out += count;
+    }
+  }
+
+  return out;
+}
+
+//=========================================================================//
+//decompress PackBits data. returns the no. of bytes written, or 0 if the data
+//is bad or does not fit
+
+uint16_t FPS_TemplateStore::decompress (const uint8_t* source, uint16_t length, uint8_t* destination, uint16_t maxLength) {
+  uint16_t in = 0;
+  uint16_t out = 0;
+
+  while(in < length) {
+    uint8_t header = source[in++];
+
+    if(header < 128) {
+      uint16_t count = header + 1;
+
+      if(((in + count) > length) || ((out + count) > maxLength)) {
+        return 0;
+      }
+
+      memcpy(destination + out, source + in, count);
+      in += count;
+      out += count;
+    }
+    else if(header > 128) {
+      uint16_t count = 257 - header;
+
+      if((in >= length) || ((out + count) > maxLength)) {
+        return 0;
+      }
+
+      memset(destination + out, source[in++], count);
+      out += count;
+    }
+    //128 is not used
+  }
+
+  return out;
+}
+
+//=========================================================================//
+//write the header from the members
+
+void FPS_TemplateStore::writeHeader (void) {
+  putLong(memory, FPS_STORE_MAGIC);
+  memory[4] = FPS_STORE_VERSION;
+  memory[5] = 0;
+  putWord(memory + 6, recordCount);
+  putLong(memory + 8, usedLength);
+  memory[12] = 0;
+  memory[13] = 0;
+
+  uint16_t checksum = 0;
+
+  for(uint8_t i=0; i < (FPS_STORE_HEADER_LENGTH - 2); i++) {
+    checksum += memory[i];
+  }
+
+  putWord(memory + 14, checksum);
+}
+
+//=========================================================================//
+//sum of the bytes of a record, leaving out the checksum itself
+
+uint16_t FPS_TemplateStore::recordChecksum (uint32_t offset) {
+  const uint8_t* record = memory + offset;
+  uint16_t payloadLength = FPS_PacketView(record, FPS_STORE_RECORD_HEADER_LENGTH).getWord(8);
+  uint16_t checksum = 0;
+
+  for(uint8_t i=0; i < (FPS_STORE_RECORD_HEADER_LENGTH - 2); i++) {
+    checksum += record[i];
+  }
+
+  record += FPS_STORE_RECORD_HEADER_LENGTH;
+
+  for(uint16_t i=0; i < payloadLength; i++) {
+    checksum += record[i];
+  }
+
+  return checksum;
+}
+
+//=========================================================================//
+//find a record that holds the same template. only the records with the same
+//hash are decompressed and compared
+
+uint32_t FPS_TemplateStore::findDuplicate (uint32_t hash, const uint8_t* data, uint16_t length) {
+  FPS_TemplateRecord record;
+  record.offset = 0;
+
+  while(nextRecord(&record)) {
+    if((record.hash == hash) && !(record.flags & FPS_STORE_FLAG_DUPLICATE)) {
+      if(payloadEquals(memory + record.offset + FPS_STORE_RECORD_HEADER_LENGTH, record.payloadLength, data, length)) {
+        return record.offset;
+      }
+    }
+  }
+
+  return 0;
+}
+
+//=========================================================================//
+//check if the offset is the start of a record before the duplicate, and that
+//the record holds the template itself and not another reference
+
+bool FPS_TemplateStore::isOriginal (uint32_t offset, const FPS_TemplateRecord* duplicate) {
+  if(offset >= duplicate->offset) { //references only point back
+    return false;
+  }
+
+  FPS_TemplateRecord record;
+  record.offset = 0;
+
+  while(nextRecord(&record) && (record.offset < offset)) {
+    //walk up to the offset
+  }
+
+  return (record.offset == offset) && !(record.flags & FPS_STORE_FLAG_DUPLICATE) && (record.hash == duplicate->hash);
+}
+
+//=========================================================================//
+//get the compressed data of a record, following the reference if the record
+//is a duplicate. returns NULL if the data doesn't lie within the used length
+
+const uint8_t* FPS_TemplateStore::getPayload (uint32_t offset, uint16_t* payloadLength) {
+  if((offset < FPS_STORE_HEADER_LENGTH) || ((offset + FPS_STORE_RECORD_HEADER_LENGTH) > usedLength)) {
+    return NULL;
+  }
+
+  FPS_PacketView recordHeader(memory + offset, FPS_STORE_RECORD_HEADER_LENGTH);
+  const uint8_t* payload = memory + offset + FPS_STORE_RECORD_HEADER_LENGTH;
+  uint16_t length = recordHeader.getWord(8);
+
+  if((offset + FPS_STORE_RECORD_HEADER_LENGTH + length) > usedLength) {  //runs past the end
+    return NULL;
+  }
+
+  if(recordHeader.getByte(2) & FPS_STORE_FLAG_DUPLICATE) {
+    if(length != 4) { //a reference is only the offset
+      return NULL;
+    }
+
+    uint32_t originalOffset = FPS_PacketView(payload, length).getLong(0);
+
+    if((originalOffset < FPS_STORE_HEADER_LENGTH) || (originalOffset >= offset)) { //references only point back
+      return NULL;
+    }
+
+    recordHeader = FPS_PacketView(memory + originalOffset, FPS_STORE_RECORD_HEADER_LENGTH);
+    payload = memory + originalOffset + FPS_STORE_RECORD_HEADER_LENGTH;
+    length = recordHeader.getWord(8);
+
+    if((originalOffset + FPS_STORE_RECORD_HEADER_LENGTH + length) > usedLength) { //the original runs past the end
+      return NULL;
+    }
+
+    if(recordHeader.getByte(2) & FPS_STORE_FLAG_DUPLICATE) {  //references are never chained
+      return NULL;
+    }
+  }
+
+  *payloadLength = length;
+  return payload;
+}
+
+//=========================================================================//
+//check if PackBits data decompresses to the same bytes, without a buffer
+
+bool FPS_TemplateStore::payloadEquals (const uint8_t* payload, uint16_t payloadLength, const uint8_t* data, uint16_t length) {
+  uint16_t in = 0;
+  uint16_t out = 0;
+
+  while(in < payloadLength) {
+    uint8_t header = payload[in++];
+
+    if(header < 128) {
+      uint16_t count = header + 1;
+
+      if(((in + count) > payloadLength) || ((out + count) > length) || (memcmp(payload + in, data + out, count) != 0)) {
+        return false;
+      }
+
+      in += count;
+      out += count;
+    }
+    else if(header > 128) {
+      uint16_t count = 257 - header;
+
+      if((in >= payloadLength) || ((out + count) > length)) {
+        return false;
+      }
+
+      for(uint16_t i=0; i < count; i++) {
+        if(data[out + i] != payload[in]) {
+          return false;
+        }
+      }
+
+      in++;
+      out += count;
+    }
+  }
+
+  return (out == length);
+}
+
+//=========================================================================//
+
+void FPS_TemplateStore::putWord (uint8_t* destination, uint16_t value) {
+  destination[0] = uint8_t(value >> 8);
+  destination[1] = uint8_t(value & 0xFFU);
+}
+
+//=========================================================================//
+
+void FPS_TemplateStore::putLong (uint8_t* destination, uint32_t value) {
+  putWord(destination, uint16_t(value >> 16));
+  putWord(destination + 2, uint16_t(value & 0xFFFFU));
+}
+
+//=========================================================================//
+//run the requests waiting in a queue. call this repeatedly from the task that
+//owns the sensor. the foreground requests are run first, in the order they
+//were pushed. a background job is then run in slices of FPS_BACKGROUND_SLICE
+//templates, and the queue is checked for foreground requests after each
+//slice, so a waiting identify is only held up by the slice in progress. the
+//job continues from where it was afterwards.
+//if there's nothing to do, the task sleeps for up to waitTime milliseconds
+//until a request is pushed. returns the no. of requests finished
+
+#ifdef FPS_REQUEST_QUEUE
+  uint16_t R30X_FPS::processRequests (FPS_RequestQueue* queue, uint32_t waitTime) {
+    FPS_Request request;
+    uint16_t requestCount = 0;
+    bool waited = false;
+    bool finished;
+    uint8_t response;
+
+    queue->setConsumer(xTaskGetCurrentTaskHandle());
+
+    while(true) {
+      //preemption point. everything in the foreground goes first
+      while(queue->pop(&request, FPS_PRIORITY_FOREGROUND)) {
+        do {
+          response = runRequest(&request, &finished);
+        } while(!finished);
+
+        finishRequest(&request, response);
+        requestCount++;
+      }
+
+      if(!backgroundActive) {
+        if(queue->pop(&backgroundRequest, FPS_PRIORITY_BACKGROUND)) {
+          backgroundActive = true;
+        }
+        else if((requestCount > 0) || (waitTime == 0) || waited) {
+          return requestCount;
+        }
+        else {
+          ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(waitTime));  //a push in the meantime leaves a notification, so it's not missed
+          waited = true;
+          continue;
+        }
+      }
+
+      response = runRequest(&backgroundRequest, &finished);
+
+      if(finished) {
+        backgroundActive = false;
+        finishRequest(&backgroundRequest, response);
+        requestCount++;
+      }
+    }
+  }
+
+  //=========================================================================//
+  //run a request. a backup or restore is run for one slice only, and finished
+  //is set when there's nothing more to copy or it failed. the others always
+  //finish in one go
+
+  uint8_t R30X_FPS::runRequest (FPS_Request* request, bool* finished) {
+    uint8_t response;
+    *finished = true;
+
+    switch(request->type) {
+      case FPS_REQUEST_IDENTIFY:
+        response = identify(request->timeout, request->minScore);
+
+        if(response == FPS_RESP_OK) {
+          request->fingerId = fingerId;
+          request->matchScore = matchScore;
+        }
+        else {
+          request->fingerId = 0;
+          request->matchScore = 0;
+        }
+        break;
+
+      case FPS_REQUEST_ENROLL:
+        response = enroll(request->location, request->timeout);
+        break;
+
+      case FPS_REQUEST_DELETE:
+        response = deleteTemplate(request->location, request->count);
+        break;
+
+      case FPS_REQUEST_BACKUP:
+      case FPS_REQUEST_RESTORE:
+        if((request->stream == NULL) || (request->backupState == NULL)) {
+          response = FPS_BAD_VALUE;
+          break;
+        }
+
+        if(request->type == FPS_REQUEST_BACKUP) {
+          response = backupLibrary(*request->stream, request->backupState, FPS_BACKGROUND_SLICE);
+        }
+        else {
+          response = restoreLibrary(*request->stream, request->backupState, FPS_BACKGROUND_SLICE);
+        }
+
+        *finished = (response != FPS_RESP_OK) || request->backupState->finished;
+        break;
+
+      default:
+        response = FPS_RESP_NODEFINITIONERR;
+        break;
+    }
+
+    return response;
+  }
+
+  //=========================================================================//
+
+  void R30X_FPS::finishRequest (FPS_Request* request, uint8_t response) {
+    #ifdef FPS_DEBUG
+      debugPort.print(F("Request done. type = "));
+      debugPort.print(request->type);
+      debugPort.print(F(", response = 0x"));
+      debugPort.println(response, HEX);
+    #endif
+
+    if(request->callback != NULL) {
+      request->callback(request, response);
+    }
+  }
+
+  //=========================================================================//
+  //a slot is free for the push at position p when its sequence is p, and holds
+  //a request for the pop at position p when its sequence is p + 1
+
+  FPS_RequestQueue::FPS_RequestQueue (void) {
+    for(uint8_t j=0; j < FPS_PRIORITY_COUNT; j++) {
+      for(uint8_t i=0; i < FPS_REQUEST_QUEUE_LENGTH; i++) {
+        lanes[j].slots[i].sequence = i;
+      }
+
+      lanes[j].pushPosition = 0;
+      lanes[j].popPosition = 0;
+    }
+
+    consumerTask = NULL;
+  }
+
+  //=========================================================================//
+  //add a request to the lane of its priority. a task claims a slot by moving
+  //pushPosition past it, so two tasks never write the same slot. the request
+  //is copied before the slot is marked full, and the sensor task is woken up
+
+  bool FPS_RequestQueue::push (const FPS_Request* request) {
+    if(request->priority >= FPS_PRIORITY_COUNT) {
+      return false;
+    }
+
+    Lane* lane = &lanes[request->priority];
+    uint32_t position = __atomic_load_n(&lane->pushPosition, __ATOMIC_RELAXED);
+    Slot* slot;
+
+    while(true) {
+      slot = &lane->slots[position & (FPS_REQUEST_QUEUE_LENGTH - 1)];
+      int32_t difference = int32_t(__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) - position);
+
+      if(difference == 0) { //free. try to claim it
+        if(__atomic_compare_exchange_n(&lane->pushPosition, &position, position + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+          break;
+        }
+        //another task got it first. position now has the new value
+      }
+      else if(difference < 0) { //still holds a request from the last round
+        return false;
+      }
+      else {  //another task has pushed already
+        position = __atomic_load_n(&lane->pushPosition, __ATOMIC_RELAXED);
+      }
+    }
+
+    slot->request = *request;
+    __atomic_store_n(&slot->sequence, position + 1, __ATOMIC_RELEASE);
+
+    TaskHandle_t task = __atomic_load_n(&consumerTask, __ATOMIC_ACQUIRE);
+
+    if(task != NULL) {
+      xTaskNotifyGive(task);
+    }
+
+    return true;
+  }
+
+  //=========================================================================//
+  //take the oldest request of a priority. the slot is given back for the next
+  //round after the request is copied out of it
+
+  bool FPS_RequestQueue::pop (FPS_Request* request, uint8_t priority) {
+    if(priority >= FPS_PRIORITY_COUNT) {
+      return false;
+    }
+
+    Lane* lane = &lanes[priority];
+    Slot* slot = &lane->slots[lane->popPosition & (FPS_REQUEST_QUEUE_LENGTH - 1)];
+
+    if(int32_t(__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) - (lane->popPosition + 1)) < 0) {
+      return false;
+    }
+
+    *request = slot->request;
+    __atomic_store_n(&slot->sequence, lane->popPosition + FPS_REQUEST_QUEUE_LENGTH, __ATOMIC_RELEASE);
+    lane->popPosition++;
+    return true;
+  }
+
+  //=========================================================================//
+
+  void FPS_RequestQueue::setConsumer (TaskHandle_t task) {
+    __atomic_store_n(&consumerTask, task, __ATOMIC_RELEASE);
+  }
+#endif
+
 //=========================================================================//
 
 //written by human, for humans.
@@ -6,7 +6,7 @@
 //  Filename : R30X_FPS.h                                                  //
 //  Description : Header file for R30X_FPS library for R30X series         //
 //                fingerprint sensors.                                     //
-//  Library version : 1.3.1                                                //
+//  Library version : 2.0.0                                                //
 //  Author : Vishnu M Aiea                                                 //
 //  Src : https://github.com/vishnumaiea/R30X-Fingerprint-Sensor-Library   //
 //  Author's website : https://www.vishnumaiea.in                          //
@@ -28,6 +28,20 @@
 
 // #include "SoftwareSerial.h"
 
+//ESP32 core 2.0 and later can call back when the UART receives data, so that
+//we can sleep instead of polling the port
+#if defined(ESP32) && defined(ESP_ARDUINO_VERSION_MAJOR)
+  #if ESP_ARDUINO_VERSION_MAJOR >= 2
+    #define FPS_RX_EVENTS
+  #endif
+#endif
+
+//on ESP32, a sensor can be run by a task of its own, and the other tasks send
+//it requests through a queue instead of calling its functions
+#if defined(ESP32)
+  #define FPS_REQUEST_QUEUE
+#endif
+
 //=========================================================================//
 
 // #if !defined(ARDUINO_AVR_UNO) && !defined(ARDUINO_AVR_MINI) && !defined(ARDUINO_AVR_NANO)
@@ -38,6 +52,19 @@
 
 #define debugPort Serial  //the serisl port to which debug info will be sent
 
+//collect per-command latency and outcome statistics. these take over 1 KB of
+//RAM, so they are not enabled on AVR by default
+#if !defined(__AVR__)
+  #define FPS_STATS   //comment this line to disable the statistics
+#endif
+
+//learn the response time of each command and use it as the timeout, so that
+//a sensor that is not responding is found out quickly. the timings take about
+//140 bytes of RAM, so they are not enabled on AVR by default
+#if !defined(__AVR__)
+  #define FPS_ADAPTIVE_TIMEOUT  //comment this line to always use FPS_DEFAULT_TIMEOUT
+#endif
+
 //=========================================================================//
 //Response codes from FPS to the commands sent to it
 //FPS = Fingerprint Scanner
@@ -82,6 +109,8 @@
 #define FPS_RX_BADPACKET                 0x01U  //if the packet received from FPS is badly formatted
 #define FPS_RX_WRONG_RESPONSE            0x02U  //unexpected response
 #define FPS_RX_TIMEOUT                   0x03U  //when no response was received
+#define FPS_RX_PENDING                   0x04U  //the response is not complete yet
+#define FPS_RX_CANCELLED                 0x05U  //the response was cancelled with cancelReceive() and is dropped
 
 //-------------------------------------------------------------------------//
 //Packet IDs
@@ -93,6 +122,7 @@
 #define FPS_ID_DATAPACKET             0x02U
 #define FPS_ID_ACKPACKET              0x07U
 #define FPS_ID_ENDDATAPACKET          0x08U
+#define FPS_ID_POWERON                0x55U    //sent by the module once it is ready after a reset
 
 //-------------------------------------------------------------------------//
 //Command codes
@@ -121,17 +151,364 @@
 #define FPS_CMD_READNOTEPAD           0x19U    //read from device notepad
 #define FPS_CMD_HISPEEDSEARCH         0x1BU    //highspeed search of fingerprint
 #define FPS_CMD_TEMPLATECOUNT         0x1DU    //read total template count
+#define FPS_CMD_READINDEXTABLE        0x1FU    //read which library locations are occupied
 #define FPS_CMD_SCANANDRANGESEARCH    0x32U    //read total template count
 #define FPS_CMD_SCANANDFULLSEARCH     0x34U    //read total template count
 
+#define FPS_STATS_COMMAND_COUNT       27       //no. of commands above, for the statistics and timeouts
+#define FPS_STATS_RESPONSE_CODES      0x46U    //response codes 0x00 to 0x45 are counted in the histogram
+
+#define FPS_STATS_COUNT               0        //fields of FPS_CommandStats, for printing them
+#define FPS_STATS_OK_COUNT            1
+#define FPS_STATS_RESPONSES           2
+#define FPS_STATS_FIRST_BYTE_TOTAL    3
+#define FPS_STATS_FIRST_BYTE_MAX      4
+#define FPS_STATS_COMPLETE_TOTAL      5
+#define FPS_STATS_COMPLETE_MAX        6
+#define FPS_STATS_BYTES_SENT          7
+#define FPS_STATS_BYTES_RECEIVED      8
+#define FPS_STATS_RETRIES             9
+#define FPS_STATS_TIMEOUTS            10
+#define FPS_STATS_ERRORS              11
+
+#if defined(__AVR__)
+  #define FPS_GROUP_MAX_SENSORS             4     //max no. of sensors in a group, the group keeps the progress of each
+#else
+  #define FPS_GROUP_MAX_SENSORS             64    //max no. of sensors in a group, up to 64
+#endif
+#define FPS_RX_RING_LENGTH                  512   //bytes buffered between the UART callback and the receiving task, a power of 2
+#define FPS_REQUEST_QUEUE_LENGTH            8     //no. of requests that can wait in a queue, a power of 2
+#define FPS_REQUEST_IDENTIFY                1     //find a finger in the library
+#define FPS_REQUEST_ENROLL                  2     //save a new finger to a location
+#define FPS_REQUEST_DELETE                  3     //delete a range of locations
+#define FPS_REQUEST_BACKUP                  4     //copy the library to a backup image
+#define FPS_REQUEST_RESTORE                 5     //copy a backup image to the library
+#define FPS_PRIORITY_FOREGROUND             0     //run before anything else, someone is waiting for it
+#define FPS_PRIORITY_BACKGROUND             1     //run in slices, between the foreground requests
+#define FPS_PRIORITY_COUNT                  2
+#define FPS_BACKGROUND_SLICE                1     //templates copied by a background job before checking for foreground requests
+#define FPS_CLONE_NEXT                      0     //read the next template from the store
+#define FPS_CLONE_IMPORT                    1     //waiting for the import command to be acknowledged
+#define FPS_CLONE_DATA                      2     //sending the template
+#define FPS_CLONE_SAVE                      3     //waiting for the save command to be acknowledged
+#define FPS_CLONE_DONE                      4     //no more templates, or the sensor failed
+#define FPS_CLONE_RETRIES                   1     //no. of times a failed template is sent again
 #define FPS_DEFAULT_TIMEOUT                 2000  //UART reading timeout in milliseconds
+#define FPS_AUTO_TIMEOUT                    0xFFFFFFFFUL  //let the library pick the timeout for the command. too long to be a real timeout
 #define FPS_DEFAULT_BAUDRATE                57600 //9600*6
 #define FPS_DEFAULT_RX_DATA_LENGTH          64    //the max length of data in a received packet
 #define FPS_DEFAULT_SECURITY_LEVEL          3     //the threshold at which the fingerprints will be matched
-#define FPS_DEFAULT_SERIAL_BUFFER_LENGTH    300   //length of the buffer used to read the serial data
+#define FPS_DEFAULT_SERIAL_BUFFER_LENGTH    FPS_MAX_FRAME_LENGTH  //length of the buffer used to read the serial data
 #define FPS_DEFAULT_PASSWORD                0xFFFFFFFF
 #define FPS_DEFAULT_ADDRESS                 0xFFFFFFFF
+#if defined(__AVR__)
+  #define FPS_MAX_DATA_LENGTH               128   //the frame buffers stay in RAM, so AVR boards only take packets up to 128 bytes
+#else
+  #define FPS_MAX_DATA_LENGTH               256   //the largest data length a packet can be configured for
+#endif
+#define FPS_FRAME_HEADER_LENGTH             9     //start code, address, packet type and packet length
+#define FPS_MAX_FRAME_LENGTH                (FPS_FRAME_HEADER_LENGTH + FPS_MAX_DATA_LENGTH + 3) //largest frame that can be sent
 #define FPS_BAD_VALUE                       0x1FU //some bad value or paramter was delivered
+#define FPS_BAD_IMAGE                       0x60U //the exported image did not pass the quality check
+#define FPS_STORE_FULL                      0x61U //not enough room left in the template store
+#define FPS_STORE_CORRUPT                   0x62U //the template store or one of its records failed the check
+#define FPS_STORE_NOT_FOUND                 0x63U //no template with the id in the template store
+#define FPS_BAD_BACKUP                      0x64U //the backup image is not valid or a record failed the check
+#define FPS_OUTPUT_FAIL                     0x65U //the output did not take all the data, eg. the card is full
+
+//-------------------------------------------------------------------------//
+//Finger detection parameters, times in milliseconds
+
+#define FPS_NO_PIN                          0xFFU //no touch pin is connected
+#define FPS_TOUCH_SLOTS                     4     //max no. of sensors with a touch pin interrupt, where the handler can't take an argument
+#define FPS_PRESENCE_ATTEMPT_TIMEOUT        500   //deadline for a single capture attempt
+#define FPS_PRESENCE_FAST_INTERVAL          0     //gap between the attempts when recently active
+#define FPS_PRESENCE_SLOW_INTERVAL          500   //gap between the attempts when idle
+#define FPS_PRESENCE_INTERVAL_STEP          50    //the gap grows by this much after each idle attempt
+#define FPS_PRESENCE_ACTIVE_PERIOD          10000 //the sensor is active for this long after a finger is detected
+
+//-------------------------------------------------------------------------//
+//Identification parameters
+
+#define FPS_IDENTIFY_HISTORY_LENGTH         8     //no. of recent matches used to find the hot range
+#define FPS_IDENTIFY_HOT_RANGE_DIVISOR      4     //the hot range is searched first only if it is smaller than librarySize / this
+
+//-------------------------------------------------------------------------//
+//Fingerprint image parameters
+
+#define FPS_IMAGE_WIDTH                     256   //width of the image in pixels
+#define FPS_IMAGE_HEIGHT                    288   //height of the image in pixels
+#define FPS_IMAGE_LENGTH                    36864 //size of the image in bytes, two 4-bit pixels per byte
+#define FPS_IMAGE_BACKGROUND_LEVEL          12    //pixels at or above this level are treated as background
+#define FPS_DEFAULT_MIN_CONTRAST            40    //minimum image contrast in percentage
+#define FPS_DEFAULT_MIN_COVERAGE            30    //minimum finger area in percentage of the image
+#define FPS_DEFAULT_MIN_CLARITY             10    //minimum ridge clarity in percentage
+
+//-------------------------------------------------------------------------//
+//Character file and template store parameters
+
+#define FPS_CHARACTER_LENGTH                512   //size of a character file (template) in bytes
+#define FPS_STORE_MAGIC                     0x46505453UL  //"FPTS", marks the start of a template store
+#define FPS_STORE_VERSION                   1     //format version of the template store
+#define FPS_STORE_HEADER_LENGTH             16    //magic, version, record count, used length and checksum
+#define FPS_STORE_RECORD_HEADER_LENGTH      12    //id, flags, hash, payload length and checksum
+#define FPS_STORE_FLAG_DELETED              0x01U //the record was removed
+#define FPS_STORE_FLAG_DUPLICATE            0x02U //the payload is the offset of an identical record
+
+//-------------------------------------------------------------------------//
+//Library backup parameters
+
+#define FPS_INDEX_TABLE_LENGTH              32    //bytes of index table per page, one bit per location
+#define FPS_INDEX_PAGE_SIZE                 256   //no. of library locations covered by one index table page
+#define FPS_BACKUP_MAGIC                    0x4650424BUL  //"FPBK", marks the start of a backup image
+#define FPS_BACKUP_VERSION                  1     //format version of the backup image
+#define FPS_BACKUP_HEADER_LENGTH            8     //magic, version and library size
+#define FPS_BACKUP_RECORD_OVERHEAD          6     //location and length before the template, checksum after it
+#define FPS_BACKUP_END_LOCATION             0     //location of the end record, which holds the template count instead of a length
+
+//-------------------------------------------------------------------------//
+//Adaptive timeouts, in milliseconds
+
+#define FPS_MIN_TIMEOUT                     20    //shortest timeout for an acknowledgement
+#define FPS_TIMEOUT_MARGIN                  150   //the learned time is multiplied by this percentage, for the jitter of steady commands
+#define FPS_MAX_TIMEOUT                     20000 //longest timeout, after backing off
+#define FPS_LONG_TIMEOUT                    10000 //timeout of the commands that erase or search the library, which depends on the no. of templates
+#define FPS_TIMEOUT_SAMPLE_LIMIT            8000  //longer response times are counted as this
+#define FPS_TIMEOUT_MAX_BACKOFF             4     //the timeout is doubled for each timeout in a row, up to this many times
+
+//-------------------------------------------------------------------------//
+//Data stream pacing
+
+#define FPS_STREAM_GAP_STEP                 100   //microseconds the gap between data packets shrinks by after a stream is accepted
+#define FPS_STREAM_MAX_GAP                  20000 //longest gap between data packets in microseconds
+#define FPS_STREAM_RETRIES                  2     //no. of times a rejected import from a buffer is sent again
+#define FPS_STREAM_REJECT_TIMEOUT           100   //milliseconds to receive a rejection once it has started arriving
+
+//-------------------------------------------------------------------------//
+//System parameter cache
+
+#define FPS_SYSPARA_CACHE_MAGIC             0x46505350UL  //"FPSP", marks a valid cache
+#define FPS_SYSPARA_CACHE_LENGTH            20    //magic, system ID, address, 4 parameters and checksum
+
+//=========================================================================//
+//the learned response time of a single command. the times are kept in
+//fractions of milliseconds, so that the averages don't lose precision
+
+#ifdef FPS_ADAPTIVE_TIMEOUT
+  struct FPS_CommandTiming {
+    uint16_t smoothedTime;  //average response time in 1/8 ms, 0 if not known yet
+    uint16_t timeVariance;  //average deviation of the response time in 1/4 ms
+    uint8_t backoff;  //no. of timeouts in a row
+  };
+#endif
+
+//=========================================================================//
+//port types for the receive loop. calling the functions of the actual serial
+//class by name skips the virtual call through Stream. this is only done on
+//cores where HardwareSerial is the class of the serial objects itself
+
+#if defined(__AVR__) || defined(ESP8266) || defined(ESP32)
+  #define FPS_DIRECT_PORT
+#endif
+
+struct FPS_StreamPort {
+  Stream* port;
+  FPS_StreamPort (Stream* stream) : port(stream) {}
+  int available (void) { return port->available(); }
+  int read (void) { return port->read(); }
+};
+
+//=========================================================================//
+//a lock-free byte ring between the UART receive callback, which only writes,
+//and the task receiving the packets, which only reads. each side moves only
+//its own index, so the other side always sees either the old or the new value.
+//the writer is whichever of the callback and the receiving task holds the fill
+//lock of the sensor, see fillRing()
+
+#ifdef FPS_RX_EVENTS
+  class FPS_ByteRing {
+    public:
+
+    FPS_ByteRing (void) : head(0), tail(0) {}
+
+    uint16_t write (const uint8_t* data, uint16_t length); //producer only. returns the no. of bytes that fitted
+    uint16_t space (void);  //producer only. no. of bytes that can be written
+    int available (void); //consumer only
+    int read (void);  //consumer only. -1 if empty
+    void clear (void);  //consumer only
+
+    private:
+
+    uint8_t buffer[FPS_RX_RING_LENGTH];
+    uint16_t head;  //where the next byte is written, free-running
+    uint16_t tail;  //where the next byte is read, free-running
+  };
+
+  struct FPS_RingPort {
+    FPS_ByteRing* ring;
+    FPS_RingPort (FPS_ByteRing* byteRing) : ring(byteRing) {}
+    int available (void) { return ring->available(); }
+    int read (void) { return ring->read(); }
+  };
+#endif
+
+#ifdef FPS_DIRECT_PORT
+  struct FPS_HardwarePort {
+    HardwareSerial* port;
+    FPS_HardwarePort (HardwareSerial* serial) : port(serial) {}
+    int available (void) { return port->HardwareSerial::available(); }
+    int read (void) { return port->HardwareSerial::read(); }
+  };
+
+  #if defined(__AVR__)
+    struct FPS_SoftwarePort {
+      SoftwareSerial* port;
+      FPS_SoftwarePort (SoftwareSerial* serial) : port(serial) {}
+      int available (void) { return port->SoftwareSerial::available(); }
+      int read (void) { return port->SoftwareSerial::read(); }
+    };
+  #endif
+#endif
+
+//=========================================================================//
+//command descriptors. the no. of data bytes each command carries is known at
+//compile time, so that sendCommand<>() can reject a wrong payload before the
+//code is ever run, and the checksums of the commands without data can be
+//worked out by the compiler. the address is only known at run time, so the
+//frames themselves are still filled in when they are sent
+
+template <uint8_t command> struct FPS_CommandInfo; //not defined for unknown commands
+
+#define FPS_COMMAND_INFO(command, length) \
+  template <> struct FPS_CommandInfo<command> { \
+    static const uint16_t payloadLength = length; \
+  };
+
+FPS_COMMAND_INFO(FPS_CMD_SCANFINGER, 0)
+FPS_COMMAND_INFO(FPS_CMD_IMAGETOCHARACTER, 1)
+FPS_COMMAND_INFO(FPS_CMD_MATCHTEMPLATES, 0)
+FPS_COMMAND_INFO(FPS_CMD_SEARCHLIBRARY, 5)
+FPS_COMMAND_INFO(FPS_CMD_GENERATETEMPLATE, 0)
+FPS_COMMAND_INFO(FPS_CMD_STORETEMPLATE, 3)
+FPS_COMMAND_INFO(FPS_CMD_LOADTEMPLATE, 3)
+FPS_COMMAND_INFO(FPS_CMD_EXPORTTEMPLATE, 1)
+FPS_COMMAND_INFO(FPS_CMD_IMPORTTEMPLATE, 1)
+FPS_COMMAND_INFO(FPS_CMD_EXPORTIMAGE, 0)
+FPS_COMMAND_INFO(FPS_CMD_IMPORTIMAGE, 0)
+FPS_COMMAND_INFO(FPS_CMD_DELETETEMPLATE, 4)
+FPS_COMMAND_INFO(FPS_CMD_CLEARLIBRARY, 0)
+FPS_COMMAND_INFO(FPS_CMD_SETSYSPARA, 2)
+FPS_COMMAND_INFO(FPS_CMD_READSYSPARA, 0)
+FPS_COMMAND_INFO(FPS_CMD_SETPASSWORD, 4)
+FPS_COMMAND_INFO(FPS_CMD_VERIFYPASSWORD, 4)
+FPS_COMMAND_INFO(FPS_CMD_GETRANDOMCODE, 0)
+FPS_COMMAND_INFO(FPS_CMD_SETDEVICEADDRESS, 4)
+FPS_COMMAND_INFO(FPS_CMD_PORTCONTROL, 1)
+FPS_COMMAND_INFO(FPS_CMD_WRITENOTEPAD, 33)
+FPS_COMMAND_INFO(FPS_CMD_READNOTEPAD, 1)
+FPS_COMMAND_INFO(FPS_CMD_HISPEEDSEARCH, 5)
+FPS_COMMAND_INFO(FPS_CMD_TEMPLATECOUNT, 0)
+FPS_COMMAND_INFO(FPS_CMD_READINDEXTABLE, 1)
+FPS_COMMAND_INFO(FPS_CMD_SCANANDRANGESEARCH, 5)
+FPS_COMMAND_INFO(FPS_CMD_SCANANDFULLSEARCH, 0)
+
+#undef FPS_COMMAND_INFO  //only for the table above
+
+//the checksum of a command packet without data
+template <uint8_t command> struct FPS_FixedCommand {
+  static const uint16_t packetLength = 3; //1 byte for command, 2 bytes for checksum
+  static const uint16_t checksum = FPS_ID_COMMANDPACKET + (packetLength >> 8) + (packetLength & 0xFFU) + command;
+};
+
+//=========================================================================//
+//a view of the data of the last received packet. the fields are read in place
+//from the receive frame, high byte first as the sensor sends them. the view is
+//valid only until the next packet is received
+
+struct FPS_PacketView {
+  const uint8_t* data;  //first byte after the confirmation code
+  uint16_t length;  //no. of data bytes
+
+  FPS_PacketView (const uint8_t* data, uint16_t length) : data(data), length(length) {}
+
+  uint8_t getByte (uint16_t offset) const { //0 if the packet is too short
+    return (offset < length) ? data[offset] : 0;
+  }
+
+  uint16_t getWord (uint16_t offset) const {  //2 bytes, high byte first
+    return (uint16_t(getByte(offset)) << 8) | getByte(offset + 1);
+  }
+
+  uint32_t getLong (uint16_t offset) const {  //4 bytes, high byte first
+    return (uint32_t(getWord(offset)) << 16) | getWord(offset + 2);
+  }
+};
+
+//=========================================================================//
+//statistics of a single command. times are in milliseconds
+
+#ifdef FPS_STATS
+  struct FPS_CommandStats {
+    uint32_t count; //no. of times the command was sent
+    uint32_t responses; //no. of valid acknowledgements received
+    uint32_t okCount; //no. of acknowledgements with FPS_RESP_OK
+    uint32_t firstByteTimeTotal;  //sum of the times from sending to the first byte of the response
+    uint32_t completeTimeTotal; //sum of the times from sending to the complete response
+    uint32_t firstByteTimeMax;  //worst time to the first byte
+    uint32_t completeTimeMax; //worst time to the complete response
+    uint32_t bytesSent; //including the data packets
+    uint32_t bytesReceived; //including the data packets
+    uint16_t retries; //no. of times the command was sent again after a failure
+    uint16_t timeouts;  //no. of receive timeouts
+    uint16_t errors;  //no. of bad or unexpected packets
+  };
+#endif
+
+//=========================================================================//
+//progress of a library backup or restore. clear it before starting, and keep
+//it (eg. in a file or EEPROM) after each call to resume an interrupted run
+
+struct FPS_BackupState {
+  uint16_t location;  //next library location to copy
+  uint16_t librarySize; //library size of the source sensor
+  uint16_t templateCount; //no. of templates copied so far
+  uint16_t checksum;  //sum of the record checksums so far, checked against the end record
+  uint32_t length;  //no. of bytes of the image completed so far. resume reading or writing from here
+  bool finished;  //true when all templates are copied
+  uint8_t indexPage;  //index table page in indexTable plus 1, 0 for none. saves reading it again on every call
+  uint8_t indexTable[FPS_INDEX_TABLE_LENGTH]; //the index table page used by backupLibrary()
+};
+
+//=========================================================================//
+//a request for a sensor run by its own task. fill in the fields the type
+//needs and push it to the queue of the sensor. the callback is called from
+//the task of the sensor when the request is done
+
+#ifdef FPS_REQUEST_QUEUE
+  struct FPS_Request;
+
+  typedef void (*FPS_RequestCallback) (const FPS_Request* request, uint8_t response);
+
+  struct FPS_Request {
+    uint8_t type; //one of FPS_REQUEST_*
+    uint8_t priority; //FPS_PRIORITY_FOREGROUND or FPS_PRIORITY_BACKGROUND
+    uint16_t location;  //where to enroll, or the first location to delete
+    uint16_t count; //no. of locations to delete
+    uint32_t timeout; //time to wait for the finger in milliseconds, 0 means forever
+    uint16_t minScore;  //lowest match score accepted by identify
+    Stream* stream; //the backup image to write or read
+    FPS_BackupState* backupState; //progress of the backup or restore
+    FPS_RequestCallback callback; //can be NULL
+    void* context;  //for the callback
+    uint16_t fingerId;  //the result of identify
+    uint16_t matchScore;
+  };
+#endif
+
+class FPS_TemplateStore; //defined after the main class
+#ifdef FPS_REQUEST_QUEUE
+  class FPS_RequestQueue;
+#endif
 
 //=========================================================================//
 //main class
@@ -179,7 +556,7 @@ class R30X_FPS {
   uint8_t rxConfirmationCode; //the return codes from the FPS
   uint16_t rxPacketChecksumL; //packet checksum long
   uint8_t rxPacketLength[2];  //packet length as an array
-  uint8_t* rxDataBuffer; //packet data buffer
+  uint8_t* rxDataBuffer; //packet data, in the order it was received. points into the receive frame
   uint32_t rxDataBufferLength;  //the length of the data only. this doesn't include instruction or confirmation code
   uint8_t rxPacketChecksum[2];  //packet checksum as array
 
@@ -187,9 +564,20 @@ class R30X_FPS {
   uint16_t matchScore;  //the match score of comparison of two fingerprints
   uint16_t templateCount; //total number of fingerprint templates in the library
 
+  uint32_t imageLength; //no. of bytes received in the last image export
+  uint32_t characterLength; //no. of bytes received in the last character file export
+  uint16_t charBufferSlot[2]; //library location loaded to each character buffer, 0 if unknown
+  bool sessionVerified; //true if the password was verified and the module has not been reset since
+  bool sysParaChanged;  //the system parameters have changed since the last import or export
+  uint16_t streamGap; //microseconds to wait after each data packet sent, adapted to what the module accepts
+  uint8_t imageContrast;  //spread of the pixel levels in the last image, in percentage
+  uint8_t imageCoverage;  //area of the last image covered by the finger, in percentage
+  uint8_t imageClarity; //sharpness of the ridges in the last image, in percentage
+
   void begin (uint32_t baud); //initializes the communication port
   void resetParameters (void); //initialize and reset and all parameters
   uint8_t verifyPassword (uint32_t password = FPS_DEFAULT_PASSWORD); //verify the user supplied password
+  uint8_t verifySession (void); //verify the saved password only if the module has not been verified since its last reset
   uint8_t setPassword (uint32_t password);  //set FPS password
   uint8_t setAddress (uint32_t address = FPS_DEFAULT_ADDRESS);  //set FPS address
   uint8_t setBaudrate (uint32_t baud);  //set UART baudrate, default is 57000
@@ -197,30 +585,211 @@ class R30X_FPS {
   uint8_t setSecurityLevel (uint8_t level); //set the threshold for fingerprint matching
   uint8_t setDataLength (uint16_t length); //set the max length of data in a packet
   uint8_t portControl (uint8_t value);  //turn the comm port on or off
-  uint8_t sendPacket (uint8_t type, uint8_t command, uint8_t* data = NULL, uint16_t dataLength = 0); //assemble and send packets to FPS
-  uint8_t receivePacket (uint32_t timeout=FPS_DEFAULT_TIMEOUT); //receive packet from FPS
+  uint8_t sendPacket (uint8_t type, uint8_t command, uint8_t* data = NULL, uint16_t dataLength = 0); //assemble and send packets to FPS. data is sent in the array order
+  uint8_t sendDataPacket (uint8_t type, uint8_t* data, uint16_t dataLength); //assemble and send data packets to FPS
+
+  //send a command that has no data, with the checksum worked out at compile time
+  template <uint8_t command> uint8_t sendCommand (void) {
+    static_assert(FPS_CommandInfo<command>::payloadLength == 0, "this command needs data");
+    return sendFixedPacket(command, FPS_FixedCommand<command>::checksum);
+  }
+
+  //send a command with data. the size of the data array is checked at compile time
+  template <uint8_t command, size_t length> uint8_t sendCommand (uint8_t (&data)[length]) {
+    static_assert(FPS_CommandInfo<command>::payloadLength == length, "wrong data length for this command");
+    return sendPacket(FPS_ID_COMMANDPACKET, command, data, length);
+  }
+  uint8_t receivePacket (uint32_t timeout=FPS_AUTO_TIMEOUT); //receive packet from FPS
+  FPS_PacketView getPacketView (void) { //data of the last received packet
+    return FPS_PacketView(rxDataBuffer, rxDataBufferLength);
+  }
+  void beginReceive (uint32_t timeout=FPS_AUTO_TIMEOUT);  //start receiving a packet without blocking
+  uint8_t pollPacket (void);  //continue receiving the packet, returns FPS_RX_PENDING until done
+  bool isReceiving (void);  //check if a packet is being received
+  void cancelReceive (void);  //drop the packet being received when it completes
+  uint8_t beginCommand (uint8_t command, uint8_t* data = NULL, uint16_t dataLength = 0, uint32_t timeout = FPS_AUTO_TIMEOUT); //send a command without waiting for the response
   uint8_t readSysPara (void); //read FPS system configuration
+  uint8_t beginReadSysPara (void);  //start reading the system configuration without waiting
+  uint8_t finishReadSysPara (uint8_t response); //extract the system configuration from the response
+  void exportSysPara (uint8_t* cache);  //save the system parameters to FPS_SYSPARA_CACHE_LENGTH bytes
+  uint8_t importSysPara (const uint8_t* cache); //use the system parameters saved by exportSysPara() instead of reading them
   uint8_t captureAndRangeSearch (uint16_t captureTimeout, uint16_t startId, uint16_t count); //scan a finger and search a range of locations
   uint8_t captureAndFullSearch (void);  //scan a finger and search the entire library
-  uint8_t generateImage (void); //scan a finger, generate an image and store it in the buffer
-  uint8_t exportImage (void); //export a fingerprint image from the sensor to the computer
-  uint8_t importImage (uint8_t* dataBuffer);  //import a fingerprint image from the computer to sensor
+  uint8_t generateImage (uint32_t timeout=FPS_DEFAULT_TIMEOUT); //scan a finger, generate an image and store it in the buffer
+  uint8_t waitForFinger (uint32_t timeout = 0); //wait for a finger and capture its image
+  void setTouchPin (uint8_t pin, uint8_t activeLevel = LOW);  //set the pin connected to the touch output of the sensor
+  uint8_t exportImage (uint8_t* imageBuffer = NULL, uint32_t bufferLength = 0); //export a fingerprint image from the sensor to the computer
+  uint8_t checkImageQuality (uint8_t minContrast = FPS_DEFAULT_MIN_CONTRAST, uint8_t minCoverage = FPS_DEFAULT_MIN_COVERAGE, uint8_t minClarity = FPS_DEFAULT_MIN_CLARITY); //check if the last exported image is good enough
+  uint8_t importImage (uint8_t* imageBuffer, uint32_t imageLength = FPS_IMAGE_LENGTH);  //import a fingerprint image from a buffer to sensor
+  uint8_t importImage (Stream* imageSource, uint32_t imageLength = FPS_IMAGE_LENGTH);  //import a fingerprint image from a stream (eg. file) to sensor
   uint8_t generateCharacter (uint8_t bufferId); //generate character file from image
   uint8_t generateTemplate (void);  //combine the two character files and generate a single template
-  uint8_t exportCharacter (uint8_t bufferId); //export a character file from the sensor to computer
-  uint8_t importCharacter (uint8_t bufferId, uint8_t* dataBuffer);  //import a character file to the sensor from computer
+  uint8_t exportCharacter (uint8_t bufferId, uint8_t* characterBuffer = NULL, uint32_t bufferLength = 0); //export a character file from the sensor to computer
+  uint8_t exportCharacter (uint8_t bufferId, Print* characterOutput); //export a character file from the sensor to a file or port
+  uint8_t importCharacter (uint8_t bufferId, uint8_t* characterBuffer, uint32_t characterLength = FPS_CHARACTER_LENGTH);  //import a character file to the sensor from a buffer
+  uint8_t importCharacter (uint8_t bufferId, Stream* characterSource, uint32_t characterLength = FPS_CHARACTER_LENGTH);  //import a character file to the sensor from a stream
   uint8_t saveTemplate (uint8_t bufferId, uint16_t location);  //store the template in the buffer to a location in the library
+  uint8_t beginSaveTemplate (uint8_t bufferId, uint16_t location); //start storing without waiting for the result
+  uint8_t finishSaveTemplate (uint8_t response);  //check the response of the store
   uint8_t loadTemplate (uint8_t bufferId, uint16_t location); //load a template from library to one of the buffers
+  uint8_t beginLoadTemplate (uint8_t bufferId, uint16_t location); //start loading without waiting for the result
+  uint8_t finishLoadTemplate (uint8_t response);  //check the response of the load
   uint8_t deleteTemplate (uint16_t startLocation, uint16_t count);  //delete a set of templates from library
   uint8_t clearLibrary (void);  //delete all templates from library
   uint8_t matchTemplates (void);  //match the templates stored in the two character buffers
+  uint8_t beginMatchTemplates (void); //start matching without waiting for the score
+  uint8_t finishMatchTemplates (uint8_t response);  //extract the match score from the response
   uint8_t searchLibrary (uint8_t bufferId, uint16_t startLocation, uint16_t count); //search the library for a template stored in the buffer
+  uint8_t beginSearchLibrary (uint8_t bufferId, uint16_t startLocation, uint16_t count); //start searching without waiting for the result
+  uint8_t finishSearchLibrary (uint8_t response); //extract the search result from the response
   uint8_t getTemplateCount (void);  //get the total no. of templates in the library
+  uint8_t beginTemplateCount (void);  //start reading the template count without waiting
+  uint8_t finishTemplateCount (uint8_t response); //extract the template count from the response
+  uint8_t readIndexTable (uint8_t page, uint8_t* indexTable); //read which locations of a library page are occupied
+  uint8_t backupLibrary (Print& output, FPS_BackupState* state, uint16_t maxTemplates = 0);  //copy the library to a backup image
+  #if !defined(__AVR__)  //these need a whole template in RAM
+    uint8_t restoreLibrary (Stream& input, FPS_BackupState* state, uint16_t maxTemplates = 0); //copy the templates from a backup image to the library
+    uint8_t exportLibrary (FPS_TemplateStore* store);  //copy the library to a template store in memory
+  #endif
+  uint8_t identify (uint32_t timeout = 0, uint16_t minScore = 0);  //capture a finger and find it in the library
+  uint8_t enroll (uint16_t location, uint32_t timeout = 0); //capture a finger twice and save it to a location
+  #ifdef FPS_REQUEST_QUEUE
+    uint16_t processRequests (FPS_RequestQueue* queue, uint32_t waitTime = 0); //run the requests waiting in a queue, from the task of the sensor
+  #endif
+
+  #ifdef FPS_STATS
+    FPS_CommandStats commandStats[FPS_STATS_COMMAND_COUNT]; //per-command statistics
+    uint16_t responseHistogram[FPS_STATS_RESPONSE_CODES]; //no. of times each response code was received
+
+    FPS_CommandStats* getCommandStats (uint8_t command);  //get the statistics of a command
+    void resetStats (void); //clear all statistics
+    void printStats (Print& output);  //print the statistics in Prometheus text format
+  #endif
+
+  #ifdef FPS_ADAPTIVE_TIMEOUT
+    FPS_CommandTiming commandTiming[FPS_STATS_COMMAND_COUNT]; //learned response times of each command
+
+    uint32_t getTimeout (uint8_t command);  //the timeout the next response to a command will get
+    void resetTimeouts (void);  //forget the learned response times
+  #endif
 
   private:
 
   Stream *mySerial; //stream class is used to facilitate communication
 
+  uint8_t txFrameBuffer[FPS_MAX_FRAME_LENGTH]; //complete frame to be sent, reused for every packet
+  uint8_t rxFrameBuffer[FPS_DEFAULT_SERIAL_BUFFER_LENGTH]; //frame being received. rxDataBuffer points into it
+  uint16_t rxFrameLength; //no. of bytes of the frame received so far
+  uint16_t rxFrameExpectedLength; //full length of the frame, known once the length bytes arrive
+  uint16_t rxDataChecksum;  //sum of the data bytes of the received frame
+  bool sysParaCached; //the parameters came from importSysPara() and the module has not answered at them yet
+  void discardSysPara (void); //go back to the default parameters and baudrate after the cached ones failed
+
+  #ifdef FPS_RX_EVENTS
+    SemaphoreHandle_t rxEventSemaphore;  //given by the UART receive callback
+    FPS_ByteRing rxRing;  //bytes copied from the UART by the receive callback
+    bool rxFillLock;  //held while moving bytes from the UART to rxRing
+    void fillRing (void); //move as many received bytes to rxRing as it can hold
+  #endif
+
+  #ifdef FPS_REQUEST_QUEUE
+    FPS_Request backgroundRequest; //the background job being run in slices
+    bool backgroundActive;
+    uint8_t runRequest (FPS_Request* request, bool* finished); //run a request, or a slice of it
+    void finishRequest (FPS_Request* request, uint8_t response);  //report the result of a request
+  #endif
+
+  uint32_t imageHistogram[16];  //pixel count of each of the 16 levels
+  uint32_t imageGradientSum;  //sum of the level changes between neighbouring pixels
+  uint32_t imageGradientCount;  //no. of neighbouring pixel pairs on the finger
+  uint16_t imagePixelColumn;  //column of the next pixel in the current row
+  uint8_t imagePreviousPixel; //level of the last pixel
+
+  uint8_t importImage (uint8_t* imageBuffer, Stream* imageSource, uint32_t imageLength); //import an image from either of the sources
+  uint8_t importCharacter (uint8_t bufferId, uint8_t* characterBuffer, Stream* characterSource, uint32_t characterLength); //import a character file from either of the sources
+  uint8_t exportCharacter (uint8_t bufferId, uint8_t* characterBuffer, uint32_t bufferLength, Print* characterOutput); //export a character file to either of the destinations
+  uint8_t receiveDataStream (uint8_t* dataBuffer, uint32_t bufferLength, Print* dataOutput, uint32_t* dataLength, bool imageData); //receive the data packets that follow an acknowledgement
+  uint16_t dataStreamChecksum;  //sum of the data bytes of the last data stream received
+  uint8_t lastCommand; //the last command sent
+  uint32_t commandSendTime; //when the last command was sent
+  bool awaitingAck;  //true until the response to the last command is received
+  bool ackTimedOut; //the last acknowledgement didn't arrive in time, and may still arrive
+
+  int8_t getCommandIndex (uint8_t command); //position of a command in commandCodes, -1 if unknown
+  #ifdef FPS_ADAPTIVE_TIMEOUT
+    void updateTimeout (uint8_t response);  //learn from the response time of the last command
+  #endif
+  #ifdef FPS_STATS
+    uint32_t statsFirstByteTime;  //when the first byte of the response was received
+
+    void updateStats (uint8_t response);  //account a received packet to the last command
+    void printMetric (Print& output, const __FlashStringHelper* name, const __FlashStringHelper* label, uint8_t code, uint32_t value);
+    void printFamily (Print& output, const __FlashStringHelper* typeLine, const __FlashStringHelper* name, uint8_t field); //print one field of every used command
+    static uint32_t getStatsField (const FPS_CommandStats* stats, uint8_t field);
+  #endif
+
+  uint8_t touchPin; //pin connected to the touch output of the sensor
+  uint8_t touchActiveLevel; //level of the touch pin when a finger is on the sensor
+  uint32_t lastFingerTime;  //when a finger was last detected
+  uint16_t presenceInterval;  //current gap between the capture attempts
+  volatile bool touchEventFlag;  //set by the touch pin interrupt of this sensor
+
+  #if defined(ESP32) || defined(ESP8266)
+    static void touchEvent (void* sensor);  //touch pin interrupt handler, gets the sensor as the argument
+  #else
+    static R30X_FPS* touchSensors[FPS_TOUCH_SLOTS]; //the sensor served by each interrupt handler
+    int8_t touchSlot; //which of the handlers serves this sensor, -1 if none
+
+    static void touchEvent0 (void); //touch pin interrupt handlers, one per slot
+    static void touchEvent1 (void);
+    static void touchEvent2 (void);
+    static void touchEvent3 (void);
+  #endif
+  bool isTouched (void);  //check if a finger is on the sensor
+  void flushInput (void); //discard the received bytes
+  int availableInput (void);  //no. of received bytes waiting
+  int readInput (void); //read a received byte
+
+  uint16_t identifyHistory[FPS_IDENTIFY_HISTORY_LENGTH]; //locations of the recent matches, 0 if empty
+  uint8_t identifyHistoryIndex; //where the next match will be saved
+
+  uint8_t finishIdentify (uint16_t minScore); //check and remember a match
+  void getHotRange (uint16_t* start, uint16_t* count);  //find where the recent matches came from
+
+  uint32_t rxStartTime;  //when beginReceive() was called
+  uint32_t rxTimeout; //how long to wait for the packet
+  bool rxPending; //true while a packet is being received
+  bool rxCancelled; //the packet being received is not wanted anymore
+
+  uint8_t finishCancelled (void); //wait out a cancelled packet before sending a command
+
+  uint8_t pendingBufferId;  //buffer of the load or store started without waiting
+  uint16_t pendingLocation; //location of the load or store started without waiting
+
+  uint8_t waitPacket (uint32_t timeout); //receive a packet, blocking until it's complete
+  void endSession (void); //forget what is known about the state of the module
+
+  uint8_t findTemplate (uint16_t* location, uint16_t lastLocation, uint8_t* indexTable, int16_t* indexPage); //move to the next occupied location
+  uint8_t checkFrame (void);  //check the received frame
+  void resetFrame (void);  //start assembling a new frame
+  bool readFrame (void);  //read the available bytes into the frame
+  template <class Port> bool readFrameFrom (Port port); //read the available bytes from a port into the frame
+  #ifdef FPS_RX_EVENTS
+    void attachReceiveEvent (void); //register the UART receive callback
+  #endif
+  uint8_t sendFixedPacket (uint8_t command, uint16_t checksum); //send a command that has no data
+  uint8_t writeCommandFrame (void); //assemble and send the command packet
+  void trackCharBuffers (void); //forget the character buffers the command being sent will change
+  uint16_t buildFrameHeader (uint8_t type, uint16_t packetLength);  //write the frame header to the frame buffer
+  static uint16_t copyWithChecksum (uint8_t* destination, const uint8_t* source, uint16_t length); //copy data and add up its bytes in one pass
+  uint8_t sendDataStream (uint8_t* dataBuffer, Stream* dataSource, uint32_t dataLength); //send data from either of the sources as packets
+  uint8_t waitStreamGap (void); //wait between data packets, watching for a rejection
+  bool retryStream (uint8_t response, uint8_t command, uint8_t* attempt); //check if a rejected import should be sent again
+
+  void resetImageQuality (void);  //clear the image quality accumulators
+  void updateImageQuality (uint8_t pixelPair);  //add two pixels to the image quality accumulators
+  void finishImageQuality (void); //calculate the image quality metrics
+
   #if defined(__AVR__) || defined(ESP8266)
     SoftwareSerial *swSerial; //for those devices with only one hardware UART
   #endif
@@ -228,6 +797,156 @@ class R30X_FPS {
   HardwareSerial *hwSerial; //for those devices with multiple hardware UARTs
 };
 
+//=========================================================================//
+//a record of the template store, as found by FPS_TemplateStore::nextRecord()
+
+struct FPS_TemplateRecord {
+  uint32_t offset;  //start of the record in the store. 0 to start a scan
+  uint16_t id;  //id given when the template was added
+  uint8_t flags;  //FPS_STORE_FLAG_ values
+  uint32_t hash;  //FNV-1a hash of the template
+  uint16_t payloadLength; //no. of bytes stored for the record
+};
+
+//=========================================================================//
+//progress of cloning the templates to one of the sensors of a group
+
+struct FPS_CloneTarget {
+  FPS_TemplateRecord record;  //template being cloned
+  uint16_t sentLength;  //no. of bytes of the template sent so far
+  uint8_t stage;  //FPS_CLONE_ value
+  uint8_t retries;  //no. of attempts left for the template
+};
+
+//=========================================================================//
+//a store of character files (templates) in a block of memory. the block can
+//be written to and loaded from a file as it is, so opening a store only needs
+//a single read. templates are compressed with PackBits run-length encoding
+//and a template identical to one already in the store is saved as a reference
+//to it. records are only appended, so format() is the way to reclaim space
+
+class FPS_TemplateStore {
+  public:
+
+  FPS_TemplateStore (uint8_t* memory, uint32_t size);
+
+  uint8_t* memory;  //the memory holding the store
+  uint32_t memorySize;  //size of the memory
+  uint32_t usedLength;  //no. of bytes used, including the header
+  uint16_t recordCount; //no. of records, including the removed ones
+  uint16_t duplicateCount;  //no. of records saved as references
+
+  uint8_t begin (bool verify = true); //open the store already in the memory
+  void format (void); //clear the store
+  uint8_t add (uint16_t id, const uint8_t* characterData, uint16_t length = FPS_CHARACTER_LENGTH); //add a template
+  uint8_t get (uint16_t id, uint8_t* characterData, uint16_t length = FPS_CHARACTER_LENGTH);  //read the latest template with the id
+  uint8_t remove (uint16_t id); //remove all templates with the id
+  bool nextRecord (FPS_TemplateRecord* record); //move to the next record, for sequential scans
+  uint8_t readRecord (const FPS_TemplateRecord* record, uint8_t* characterData, uint16_t length = FPS_CHARACTER_LENGTH);  //read the template of a record
+  uint32_t save (Print& output);  //write the used part of the memory to a file or port
+  uint8_t load (Stream& input, bool verify = true); //read a store saved with save()
+
+  static uint32_t hash (const uint8_t* data, uint16_t length); //FNV-1a hash
+  static uint16_t compress (const uint8_t* source, uint16_t length, uint8_t* destination, uint16_t maxLength);  //returns 0 if it doesn't fit
+  static uint16_t decompress (const uint8_t* source, uint16_t length, uint8_t* destination, uint16_t maxLength);  //returns 0 if the data is bad
+
+  private:
+
+  void writeHeader (void);  //update the header from the members
+  uint16_t recordChecksum (uint32_t offset); //sum of the record bytes, except the checksum
+  uint32_t findDuplicate (uint32_t hash, const uint8_t* data, uint16_t length); //offset of an identical record, 0 if none
+  const uint8_t* getPayload (uint32_t offset, uint16_t* payloadLength); //follow the references to the compressed data
+  bool isOriginal (uint32_t offset, const FPS_TemplateRecord* duplicate);  //check the target of a reference
+  static bool payloadEquals (const uint8_t* payload, uint16_t payloadLength, const uint8_t* data, uint16_t length);
+  static void putWord (uint8_t* destination, uint16_t value);  //high byte first
+  static void putLong (uint8_t* destination, uint32_t value);  //high byte first
+};
+
+//=========================================================================//
+//drives the non-blocking receives of a group of sensors from a single loop.
+//start commands on the sensors with beginCommand() (or the other begin
+//functions) and call poll() or waitAll(). the callback is called for each
+//sensor as its response completes
+
+typedef void (*FPS_CompletionCallback) (R30X_FPS* sensor, uint8_t index, uint8_t response, void* context);
+
+class R30X_FPS_Group {
+  public:
+
+  R30X_FPS_Group (R30X_FPS** sensors, uint8_t count);
+
+  R30X_FPS** sensors; //the sensors in the group
+  uint8_t sensorCount;  //no. of sensors in the group
+  uint8_t lastResponse[FPS_GROUP_MAX_SENSORS];  //the last completed response of each sensor
+
+  void onComplete (FPS_CompletionCallback callback, void* context = NULL);  //set the completion callback
+  uint8_t poll (void);  //poll each receiving sensor once, returns the no. still receiving
+  uint8_t waitAll (void); //poll until no sensor is receiving
+  uint8_t receivingCount (void);  //no. of sensors still receiving
+  uint8_t cloneLibrary (FPS_TemplateStore* source, uint8_t* templateBuffers); //load the templates of a store to all the sensors
+  #if !defined(__AVR__)  //needs a whole character file in RAM
+    uint8_t identify (uint8_t sourceIndex, uint32_t timeout = 0, uint16_t minScore = 0); //capture a finger on one sensor and search all the libraries
+  #endif
+
+  uint16_t clonedCount; //no. of templates saved by the last cloneLibrary(), on all the sensors
+  uint32_t cloneTime; //duration of the last cloneLibrary() in milliseconds
+  uint8_t matchIndex; //the sensor the last identify() found the finger on
+  uint16_t fingerId;  //location of the match in the library of that sensor, 0 if not found
+  uint16_t matchScore;  //match score of the last identify()
+
+  private:
+
+  FPS_CompletionCallback completionCallback;
+  void* completionContext;
+  uint8_t nextIndex;  //the sensor polled first, rotated for fairness
+  FPS_CloneTarget targets[FPS_GROUP_MAX_SENSORS]; //progress of the transfer to each sensor, kept here and not on the stack
+  #if !defined(__AVR__)
+    uint8_t characterData[FPS_CHARACTER_LENGTH];  //character file sent to all the sensors by identify()
+  #endif
+
+  void beginImport (uint8_t index, FPS_CloneTarget* target); //start sending the template of a target
+  void failClone (uint8_t index, FPS_CloneTarget* target, uint8_t response); //retry the template or give up on the sensor
+  #if !defined(__AVR__)
+    void broadcastCharacter (uint8_t sourceIndex, uint16_t characterLength, uint64_t* active);  //import the character file to all the other sensors
+  #endif
+};
+
+//=========================================================================//
+//a bounded lock-free queue that any no. of tasks can push requests to, and
+//one task, the one running the sensor, takes them from. there's a lane of
+//slots for each priority. every slot has a sequence no. that tells whether
+//it's free for the current round or holds a request, so a producer only
+//needs a compare-and-swap to claim a slot.
+//the sensor and its public members must only be used by the sensor task
+
+#ifdef FPS_REQUEST_QUEUE
+  class FPS_RequestQueue {
+    public:
+
+    FPS_RequestQueue (void);
+
+    bool push (const FPS_Request* request);  //from any task. false if the lane of its priority is full
+    bool pop (FPS_Request* request, uint8_t priority);  //from the sensor task only. false if the lane is empty
+    void setConsumer (TaskHandle_t task); //the task to wake up when a request is pushed
+
+    private:
+
+    struct Slot {
+      uint32_t sequence;
+      FPS_Request request;
+    };
+
+    struct Lane {
+      Slot slots[FPS_REQUEST_QUEUE_LENGTH];
+      uint32_t pushPosition;  //claimed by the producers
+      uint32_t popPosition; //only used by the consumer
+    };
+
+    Lane lanes[FPS_PRIORITY_COUNT];
+    TaskHandle_t consumerTask;
+  };
+#endif
+
 //=========================================================================//
 
 #endif